@@ -1,30 +1,78 @@
 #include "pch.h"
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <functional>
 #include <fstream>
-#include <iterator>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace fs = std::filesystem;
 
 bool is_unsafe;
 
-static bool get_safe_path(lua_State* thread, const fs::path& user_path, fs::path& out_path) {
-    fs::path sandbox = fs::current_path() / "runluau-filesystem";
+// Safe mode's sandbox root, resolved once per working directory instead of on every call
+static fs::path sandbox_root;
+static std::wstring sandbox_cwd;
+
+static std::wstring current_directory() {
+    DWORD size = GetCurrentDirectoryW(0, NULL);
+    std::wstring cwd(size, L'\0');
+    cwd.resize(GetCurrentDirectoryW(size, cwd.data()));
+    return cwd;
+}
+
+// Re-resolves the root if the working directory changed. GetCurrentDirectoryW only reads process memory, so
+// checking costs no syscall. Returns false if the sandbox directory can't be created.
+static bool update_sandbox_root() {
+    std::wstring cwd = current_directory();
+    if (!sandbox_root.empty() && cwd == sandbox_cwd) {
+        return true;
+    }
 
     std::error_code ec;
-    if (!fs::exists(sandbox, ec)) {
-        if (!fs::create_directory(sandbox, ec)) {
-            lua_pushstring(thread, "Filesystem safe mode: Failed to create sandbox directory");
-            lua_error(thread);
-            return false;
-        }
+    fs::path root = fs::path(cwd) / "runluau-filesystem";
+    fs::create_directory(root, ec);
+    if (ec) {
+        return false;
+    }
+    root = fs::weakly_canonical(root, ec);
+    if (ec) {
+        return false;
+    }
+    sandbox_root = std::move(root);
+    sandbox_cwd = std::move(cwd);
+    return true;
+}
+
+// A plain prefix compare would also accept siblings like `runluau-filesystem-evil`, so the prefix has to end at a separator
+static bool is_inside_sandbox(const fs::path::string_type& path, const fs::path::string_type& root) {
+    if (path.compare(0, root.size(), root) != 0) {
+        return false;
+    }
+    return path.size() == root.size() || path[root.size()] == L'\\' || path[root.size()] == L'/';
+}
+
+// Purely lexical, against the cached root
+static bool get_safe_path(lua_State* thread, const fs::path& user_path, fs::path& out_path) {
+    if (!update_sandbox_root()) {
+        lua_pushstring(thread, "Filesystem safe mode: Failed to create sandbox directory");
+        lua_error(thread);
+        return false;
     }
 
     fs::path relative = user_path;
-    if (relative.is_absolute()) {
+    if (relative.has_root_path()) {
         relative = relative.relative_path();
     }
 
@@ -38,12 +86,10 @@ static bool get_safe_path(lua_State* thread, const fs::path& user_path, fs::path
         }
     }
 
-    fs::path safe_path = sandbox / relative;
+    fs::path safe_path = sandbox_root / relative;
     safe_path = safe_path.lexically_normal();
 
-    std::string sandbox_str = sandbox.string();
-    std::string safe_path_str = safe_path.string();
-    if (safe_path_str.compare(0, sandbox_str.size(), sandbox_str) != 0) {
+    if (!is_inside_sandbox(safe_path.native(), sandbox_root.native())) {
         lua_pushstring(thread, "Filesystem safe mode: Path escapes sandbox");
         lua_error(thread);
         return false;
@@ -53,9 +99,57 @@ static bool get_safe_path(lua_State* thread, const fs::path& user_path, fs::path
     return true;
 }
 
+// Closes the handle when it goes out of scope, including when lua_error unwinds past it
+struct file_handle {
+    HANDLE handle = INVALID_HANDLE_VALUE;
+
+    ~file_handle() {
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+    }
+};
+
+static std::string last_error_message() {
+    return std::system_category().message(GetLastError());
+}
+
+// Opens a file and gets its size up front, so the contents can be read once straight into the Lua value they end up in
+static bool open_for_read(lua_State* thread, const fs::path& path, file_handle& file, size_t& size) {
+    if (fs::is_directory(path)) {
+        lua_pushstring(thread, "Path is a directory, cannot open as a file");
+        lua_error(thread);
+        return false;
+    }
+
+    file.handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER file_size;
+    if (file.handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(file.handle, &file_size)) {
+        lua_pushfstring(thread, "Failed to read file: %s", last_error_message().c_str());
+        lua_error(thread);
+        return false;
+    }
+    size = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+// ReadFile takes at most 4 GB at a time and can return less than asked for
+static bool read_exact(HANDLE file, char* data, size_t size) {
+    while (size > 0) {
+        DWORD chunk = size > MAXDWORD ? MAXDWORD : static_cast<DWORD>(size);
+        DWORD read;
+        if (!ReadFile(file, data, chunk, &read, NULL) || read == 0) {
+            return false;
+        }
+        data += read;
+        size -= read;
+    }
+    return true;
+}
+
 int read_file(lua_State* thread) {
     wanted_arg_count(1);
-    stack_slots_needed(1);
+    stack_slots_needed(2);
 
     size_t length;
     const char* path_c_str = luaL_checklstring(thread, 1, &length);
@@ -67,24 +161,50 @@ int read_file(lua_State* thread) {
         }
     }
 
-    if (fs::is_directory(path)) {
-        lua_pushstring(thread, "Path is a directory, cannot open as a file");
-        lua_error(thread);
+    file_handle file;
+    size_t size;
+    if (!open_for_read(thread, path, file, size)) {
         return 0;
     }
 
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        lua_pushfstring(thread, "Failed to read file: %s", std::strerror(errno));
+    // Big enough string buffers are the string object itself, so finishing it doesn't copy
+    luaL_Strbuf buffer;
+    char* data = luaL_buffinitsize(thread, &buffer, size);
+    if (!read_exact(file.handle, data, size)) {
+        lua_pushfstring(thread, "Failed to read file: %s", last_error_message().c_str());
         lua_error(thread);
         return 0;
     }
+    luaL_pushresultsize(&buffer, size);
+    return 1;
+}
 
-    std::vector<char> buffer((std::istreambuf_iterator<char>(file)),
-                              std::istreambuf_iterator<char>());
-    file.close();
-    std::string content(buffer.begin(), buffer.end());
-    lua_pushlstring(thread, content.data(), content.size());
+int read_buffer(lua_State* thread) {
+    wanted_arg_count(1);
+    stack_slots_needed(1);
+
+    size_t length;
+    const char* path_c_str = luaL_checklstring(thread, 1, &length);
+    fs::path path(std::string(path_c_str, length));
+
+    if (!is_unsafe) {
+        if (!get_safe_path(thread, path, path)) {
+            return 0;
+        }
+    }
+
+    file_handle file;
+    size_t size;
+    if (!open_for_read(thread, path, file, size)) {
+        return 0;
+    }
+
+    void* data = lua_newbuffer(thread, size);
+    if (!read_exact(file.handle, static_cast<char*>(data), size)) {
+        lua_pushfstring(thread, "Failed to read file: %s", last_error_message().c_str());
+        lua_error(thread);
+        return 0;
+    }
     return 1;
 }
 
@@ -210,6 +330,45 @@ int is_folder(lua_State* thread) {
     return 1;
 }
 
+// Directory entries as FindFirstFileExW returns them already carry the type, size and modification time,
+// so listing with them costs no extra syscalls per entry
+enum class entry_type : uint8_t {
+    file,
+    folder,
+    symlink,
+};
+constexpr const char* ENTRY_TYPE_NAMES[] = {"file", "folder", "symlink"};
+
+static entry_type find_data_type(const WIN32_FIND_DATAW& data) {
+    if ((data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+        && (data.dwReserved0 == IO_REPARSE_TAG_SYMLINK || data.dwReserved0 == IO_REPARSE_TAG_MOUNT_POINT)) {
+        return entry_type::symlink;
+    }
+    return (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? entry_type::folder : entry_type::file;
+}
+static bool is_dot_entry(const wchar_t* name) {
+    return name[0] == L'.' && (name[1] == 0 || (name[1] == L'.' && name[2] == 0));
+}
+static double filetime_to_unix(FILETIME time) {
+    ULARGE_INTEGER ticks;
+    ticks.LowPart = time.dwLowDateTime;
+    ticks.HighPart = time.dwHighDateTime;
+    return (static_cast<double>(ticks.QuadPart) - 116444736000000000.0) / 10000000.0;
+}
+
+static std::string to_utf8(const wchar_t* string, int length) {
+    int size = WideCharToMultiByte(CP_UTF8, 0, string, length, NULL, 0, NULL, NULL);
+    std::string result(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, string, length, result.data(), size, NULL, NULL);
+    return result;
+}
+// path::string() goes through the ANSI code page, which mangles or throws on names it can't represent
+static std::string to_utf8(const fs::path& path) {
+    const fs::path::string_type& native = path.native();
+    return to_utf8(native.data(), static_cast<int>(native.size()));
+}
+
+// list(path, {include_stats}) -> {name} | {{name, type, size, mtime}}
 int list(lua_State* thread) {
     wanted_arg_count(1);
     stack_slots_needed(3);
@@ -221,6 +380,15 @@ int list(lua_State* thread) {
         }
     }
 
+    bool include_stats = false;
+    if (lua_gettop(thread) >= 2 && !lua_isnil(thread, 2)) {
+        luaL_checktype(thread, 2, LUA_TTABLE);
+        if (lua_getfield(thread, 2, "include_stats")) {
+            include_stats = luaL_checkboolean(thread, -1);
+        }
+        lua_pop(thread, 1);
+    }
+
     if (!fs::is_directory(path)) {
         if (fs::exists(path)) {
             lua_pushstring(thread, "Failed to list files: Expected folder, found file");
@@ -231,13 +399,48 @@ int list(lua_State* thread) {
         return 0;
     }
 
-    lua_newtable(thread);
-    int current = 0;
-    for (const auto& file : fs::directory_iterator(path)) {
-        std::string filename = file.path().filename().string();
-        lua_pushinteger(thread, ++current);
-        lua_pushlstring(thread, filename.data(), filename.size());
-        lua_settable(thread, -3);
+    if (!include_stats) {
+        std::vector<std::string> names;
+        for (const auto& file : fs::directory_iterator(path)) {
+            names.push_back(to_utf8(file.path().filename()));
+        }
+        lua_createtable(thread, static_cast<int>(names.size()), 0);
+        for (size_t i = 0; i < names.size(); i++) {
+            lua_pushlstring(thread, names[i].data(), names[i].size());
+            lua_rawseti(thread, -2, static_cast<int>(i + 1));
+        }
+        return 1;
+    }
+
+    std::vector<WIN32_FIND_DATAW> entries;
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileExW((path.native() + L"\\*").c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE) {
+        lua_pushfstring(thread, "Failed to list files: %s", last_error_message().c_str());
+        lua_error(thread);
+        return 0;
+    }
+    do {
+        if (!is_dot_entry(data.cFileName)) {
+            entries.push_back(data);
+        }
+    } while (FindNextFileW(find, &data));
+    FindClose(find);
+
+    lua_createtable(thread, static_cast<int>(entries.size()), 0);
+    for (size_t i = 0; i < entries.size(); i++) {
+        const WIN32_FIND_DATAW& entry = entries[i];
+        lua_createtable(thread, 0, 4);
+        std::string name = to_utf8(entry.cFileName, static_cast<int>(wcslen(entry.cFileName)));
+        lua_pushlstring(thread, name.data(), name.size());
+        lua_setfield(thread, -2, "name");
+        lua_pushstring(thread, ENTRY_TYPE_NAMES[static_cast<int>(find_data_type(entry))]);
+        lua_setfield(thread, -2, "type");
+        lua_pushnumber(thread, static_cast<double>((static_cast<uint64_t>(entry.nFileSizeHigh) << 32) | entry.nFileSizeLow));
+        lua_setfield(thread, -2, "size");
+        lua_pushnumber(thread, filetime_to_unix(entry.ftLastWriteTime));
+        lua_setfield(thread, -2, "mtime");
+        lua_rawseti(thread, -2, static_cast<int>(i + 1));
     }
     return 1;
 }
@@ -308,22 +511,1527 @@ int delete_folder(lua_State* thread) {
     return 0;
 }
 
-#define reg(name) {#name, name}
-constexpr luaL_Reg library[] = {
-    reg(read_file),
-    reg(write_file),
-    reg(append_file),
-    reg(exists),
-    reg(is_file),
-    reg(is_folder),
-    reg(list),
-    reg(new_folder),
-    reg(delete_file),
-    reg(delete_folder),
+// Handles from `open`, buffered like C's FILE so lots of small reads and writes don't each become a syscall.
+// The buffer holds either unread data or unwritten data, never both, and switches direction by flushing
+// writes or seeking back over unread data.
+constexpr const char* FILE_HANDLE_TYPE = "FileHandle";
+constexpr size_t FILE_BUFFER_SIZE = 64 * 1024;
+
+struct file_object {
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    bool readable = false;
+    bool writable = false;
+    std::unique_ptr<char[]> buffer = std::make_unique<char[]>(FILE_BUFFER_SIZE);
+    size_t read_position = 0; // Unread data is buffer[read_position, read_end)
+    size_t read_end = 0;
+    size_t write_end = 0; // Unwritten data is buffer[0, write_end)
+
+    ~file_object() {
+        if (handle != INVALID_HANDLE_VALUE) {
+            flush();
+            CloseHandle(handle);
+        }
+    }
+
+    bool write_direct(const char* data, size_t size) {
+        while (size > 0) {
+            DWORD chunk = size > MAXDWORD ? MAXDWORD : static_cast<DWORD>(size);
+            DWORD written;
+            if (!WriteFile(handle, data, chunk, &written, NULL)) {
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+    bool flush() {
+        size_t size = write_end;
+        write_end = 0;
+        return write_direct(buffer.get(), size);
+    }
+    // Moves the OS position back to where the reader is, so the next write or seek starts there
+    bool drop_read_buffer() {
+        LARGE_INTEGER back;
+        back.QuadPart = -static_cast<LONGLONG>(read_end - read_position);
+        read_position = read_end = 0;
+        return back.QuadPart == 0 || SetFilePointerEx(handle, back, NULL, FILE_CURRENT);
+    }
+    // Returns how much was read, which is less than `size` at the end of the file
+    bool read(char* out, size_t size, size_t& total) {
+        total = 0;
+        if (write_end && !flush()) {
+            return false;
+        }
+        while (size > 0) {
+            if (read_position < read_end) {
+                size_t available = read_end - read_position;
+                size_t count = size < available ? size : available;
+                memcpy(out, buffer.get() + read_position, count);
+                read_position += count;
+                out += count;
+                size -= count;
+                total += count;
+                continue;
+            }
+            // Big reads skip the buffer
+            char* target = size >= FILE_BUFFER_SIZE ? out : buffer.get();
+            DWORD chunk = size >= FILE_BUFFER_SIZE ? (size > MAXDWORD ? MAXDWORD : static_cast<DWORD>(size)) : static_cast<DWORD>(FILE_BUFFER_SIZE);
+            DWORD read;
+            if (!ReadFile(handle, target, chunk, &read, NULL)) {
+                return false;
+            }
+            if (read == 0) {
+                break;
+            }
+            if (target == out) {
+                out += read;
+                size -= read;
+                total += read;
+            } else {
+                read_position = 0;
+                read_end = read;
+            }
+        }
+        return true;
+    }
+    bool write(const char* data, size_t size) {
+        if (read_end && !drop_read_buffer()) {
+            return false;
+        }
+        if (write_end + size > FILE_BUFFER_SIZE) {
+            if (!flush()) {
+                return false;
+            }
+            if (size >= FILE_BUFFER_SIZE) {
+                return write_direct(data, size);
+            }
+        }
+        memcpy(buffer.get() + write_end, data, size);
+        write_end += size;
+        return true;
+    }
+};
+
+static file_object* check_file(lua_State* thread, int arg) {
+    file_object* file = static_cast<file_object*>(luaL_checkudata(thread, arg, FILE_HANDLE_TYPE));
+    if (file->handle == INVALID_HANDLE_VALUE) {
+        lua_pushstring(thread, "File is closed");
+        lua_error(thread);
+    }
+    return file;
+}
+static void file_error(lua_State* thread, const char* action) {
+    lua_pushfstring(thread, "Failed to %s file: %s", action, last_error_message().c_str());
+    lua_error(thread);
+}
+
+// open(path, mode) -> FileHandle
+// Modes are the same as C's fopen: "r", "w", "a", "r+", "w+" and "a+", with "b" ignored since nothing is translated
+int open_file(lua_State* thread) {
+    wanted_arg_count(1);
+    stack_slots_needed(2);
+
+    size_t path_length;
+    const char* path_c_str = luaL_checklstring(thread, 1, &path_length);
+    fs::path path(std::string(path_c_str, path_length));
+    std::string mode = luaL_optstring(thread, 2, "r");
+    mode.erase(std::remove(mode.begin(), mode.end(), 'b'), mode.end());
+
+    if (!is_unsafe) {
+        if (!get_safe_path(thread, path, path)) {
+            return 0;
+        }
+    }
+
+    DWORD access;
+    DWORD disposition;
+    if (mode == "r") {
+        access = GENERIC_READ, disposition = OPEN_EXISTING;
+    } else if (mode == "r+") {
+        access = GENERIC_READ | GENERIC_WRITE, disposition = OPEN_EXISTING;
+    } else if (mode == "w") {
+        access = GENERIC_WRITE, disposition = CREATE_ALWAYS;
+    } else if (mode == "w+") {
+        access = GENERIC_READ | GENERIC_WRITE, disposition = CREATE_ALWAYS;
+    } else if (mode == "a") {
+        access = FILE_APPEND_DATA, disposition = OPEN_ALWAYS;
+    } else if (mode == "a+") {
+        access = GENERIC_READ | FILE_APPEND_DATA, disposition = OPEN_ALWAYS;
+    } else {
+        lua_pushfstring(thread, "Invalid file mode \"%s\"", mode.c_str());
+        lua_error(thread);
+        return 0;
+    }
+
+    if (fs::is_directory(path)) {
+        lua_pushstring(thread, "Path is a directory, cannot open as a file");
+        lua_error(thread);
+        return 0;
+    }
+    if (disposition != OPEN_EXISTING) {
+        fs::path parent = path.parent_path();
+        if (!parent.empty() && parent != path) {
+            fs::create_directories(parent);
+        }
+    }
+
+    file_object* file = static_cast<file_object*>(lua_newuserdatadtor(thread, sizeof(file_object), [](void* ud) {
+        static_cast<file_object*>(ud)->~file_object();
+    }));
+    new (file) file_object();
+    luaL_getmetatable(thread, FILE_HANDLE_TYPE);
+    lua_setmetatable(thread, -2);
+
+    file->handle = CreateFileW(path.c_str(), access, FILE_SHARE_READ, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file->handle == INVALID_HANDLE_VALUE) {
+        file_error(thread, "open");
+        return 0;
+    }
+    file->readable = (access & GENERIC_READ) != 0;
+    file->writable = access != GENERIC_READ;
+    return 1;
+}
+
+// file:read(count) -> string?
+// Reads everything left without a count. Returns nil at the end of the file.
+int file_read(lua_State* thread) {
+    stack_slots_needed(2);
+    file_object* file = check_file(thread, 1);
+    if (!file->readable) {
+        lua_pushstring(thread, "File is not open for reading");
+        lua_error(thread);
+        return 0;
+    }
+
+    size_t count;
+    if (lua_isnoneornil(thread, 2)) {
+        LARGE_INTEGER size;
+        LARGE_INTEGER position;
+        LARGE_INTEGER zero{};
+        if (!file->flush() || !GetFileSizeEx(file->handle, &size) || !SetFilePointerEx(file->handle, zero, &position, FILE_CURRENT)) {
+            file_error(thread, "read");
+            return 0;
+        }
+        LONGLONG left = size.QuadPart - position.QuadPart + static_cast<LONGLONG>(file->read_end - file->read_position);
+        count = left > 0 ? static_cast<size_t>(left) : 0;
+    } else {
+        count = luaL_checkunsigned(thread, 2);
+    }
+
+    luaL_Strbuf buffer;
+    char* data = luaL_buffinitsize(thread, &buffer, count);
+    size_t read;
+    if (!file->read(data, count, read)) {
+        file_error(thread, "read");
+        return 0;
+    }
+    if (read == 0 && count > 0) {
+        lua_pushnil(thread);
+        return 1;
+    }
+    luaL_pushresultsize(&buffer, read);
+    return 1;
+}
+
+// file:read_into(buffer, offset, count) -> number
+// Returns how many bytes were read, which is less than `count` at the end of the file
+int file_read_into(lua_State* thread) {
+    wanted_arg_count(2);
+    stack_slots_needed(1);
+    file_object* file = check_file(thread, 1);
+    size_t buffer_size;
+    char* data = static_cast<char*>(luaL_checkbuffer(thread, 2, &buffer_size));
+    size_t offset = luaL_optunsigned(thread, 3, 0);
+    if (offset > buffer_size) {
+        lua_pushstring(thread, "Offset is out of the buffer's bounds");
+        lua_error(thread);
+        return 0;
+    }
+    size_t count = lua_isnoneornil(thread, 4) ? buffer_size - offset : luaL_checkunsigned(thread, 4);
+    if (count > buffer_size - offset) {
+        lua_pushstring(thread, "Count is out of the buffer's bounds");
+        lua_error(thread);
+        return 0;
+    }
+    if (!file->readable) {
+        lua_pushstring(thread, "File is not open for reading");
+        lua_error(thread);
+        return 0;
+    }
+
+    size_t read;
+    if (!file->read(data + offset, count, read)) {
+        file_error(thread, "read");
+        return 0;
+    }
+    lua_pushunsigned(thread, static_cast<unsigned int>(read));
+    return 1;
+}
+
+// file:write(string | buffer)
+int file_write(lua_State* thread) {
+    wanted_arg_count(2);
+    file_object* file = check_file(thread, 1);
+    size_t size;
+    const char* data;
+    if (lua_type(thread, 2) == LUA_TBUFFER) {
+        data = static_cast<const char*>(lua_tobuffer(thread, 2, &size));
+    } else {
+        data = luaL_checklstring(thread, 2, &size);
+    }
+    if (!file->writable) {
+        lua_pushstring(thread, "File is not open for writing");
+        lua_error(thread);
+        return 0;
+    }
+    if (!file->write(data, size)) {
+        file_error(thread, "write");
+        return 0;
+    }
+    return 0;
+}
+
+// file:seek(whence, offset) -> number
+// `whence` is "set", "cur" or "end" like Lua's file:seek, and defaults to "cur"
+int file_seek(lua_State* thread) {
+    stack_slots_needed(1);
+    file_object* file = check_file(thread, 1);
+    const char* whence = luaL_optstring(thread, 2, "cur");
+    LARGE_INTEGER offset;
+    offset.QuadPart = static_cast<LONGLONG>(luaL_optnumber(thread, 3, 0));
+    DWORD method;
+    if (strcmp(whence, "set") == 0) {
+        method = FILE_BEGIN;
+    } else if (strcmp(whence, "cur") == 0) {
+        method = FILE_CURRENT;
+    } else if (strcmp(whence, "end") == 0) {
+        method = FILE_END;
+    } else {
+        lua_pushfstring(thread, "Invalid seek origin \"%s\"", whence);
+        lua_error(thread);
+        return 0;
+    }
+
+    LARGE_INTEGER position;
+    if (!file->flush() || !file->drop_read_buffer() || !SetFilePointerEx(file->handle, offset, &position, method)) {
+        file_error(thread, "seek");
+        return 0;
+    }
+    lua_pushnumber(thread, static_cast<double>(position.QuadPart));
+    return 1;
+}
+
+int file_flush(lua_State* thread) {
+    file_object* file = check_file(thread, 1);
+    if (!file->flush()) {
+        file_error(thread, "flush");
+        return 0;
+    }
+    return 0;
+}
+
+int file_close(lua_State* thread) {
+    file_object* file = check_file(thread, 1);
+    bool flushed = file->flush();
+    CloseHandle(file->handle);
+    file->handle = INVALID_HANDLE_VALUE;
+    if (!flushed) {
+        file_error(thread, "flush");
+        return 0;
+    }
+    return 0;
+}
+
+int file_lines_next(lua_State* thread) {
+    stack_slots_needed(1);
+    file_object* file = check_file(thread, lua_upvalueindex(1));
+    if (file->write_end && !file->flush()) {
+        file_error(thread, "read");
+        return 0;
+    }
+    std::string line;
+    bool found_any = false;
+    for (;;) {
+        if (file->read_position == file->read_end) {
+            DWORD read;
+            if (!ReadFile(file->handle, file->buffer.get(), static_cast<DWORD>(FILE_BUFFER_SIZE), &read, NULL)) {
+                file_error(thread, "read");
+                return 0;
+            }
+            file->read_position = 0;
+            file->read_end = read;
+            if (read == 0) {
+                break;
+            }
+        }
+        found_any = true;
+        const char* start = file->buffer.get() + file->read_position;
+        const char* newline = static_cast<const char*>(memchr(start, '\n', file->read_end - file->read_position));
+        if (newline) {
+            line.append(start, newline);
+            file->read_position += newline - start + 1;
+            lua_pushlstring(thread, line.data(), line.size());
+            return 1;
+        }
+        line.append(start, file->read_end - file->read_position);
+        file->read_position = file->read_end;
+    }
+    if (!found_any) {
+        lua_pushnil(thread);
+        return 1;
+    }
+    lua_pushlstring(thread, line.data(), line.size());
+    return 1;
+}
+// file:lines() -> iterator
+// Lines don't include the "\n"
+int file_lines(lua_State* thread) {
+    stack_slots_needed(1);
+    file_object* file = check_file(thread, 1);
+    if (!file->readable) {
+        lua_pushstring(thread, "File is not open for reading");
+        lua_error(thread);
+        return 0;
+    }
+    lua_pushvalue(thread, 1);
+    lua_pushcclosure(thread, file_lines_next, "lines", 1);
+    return 1;
+}
+
+constexpr luaL_Reg file_methods[] = {
+    {"read", file_read},
+    {"read_into", file_read_into},
+    {"write", file_write},
+    {"seek", file_seek},
+    {"flush", file_flush},
+    {"close", file_close},
+    {"lines", file_lines},
     {NULL, NULL}
 };
 
-extern "C" __declspec(dllexport) void register_library(lua_State* thread) {
-    luaL_register(thread, "fs", library);
-    is_unsafe = luau::is_plugin_loaded("runluau-osunsafe.dll");
+// `fs.async` runs the same operations on a pool of IO threads. The calling thread yields, and when the job is done
+// it's queued to be resumed with (ok, value), which the continuation turns back into a return value or an error on
+// the calling thread. Paths are resolved before yielding so safe mode errors are raised synchronously.
+struct async_job {
+    lua_State* thread;
+    int ref; // Keeps the yielded thread alive
+    std::string error; // Empty on success
+    std::string data;
+    std::vector<std::string> names;
+};
+using async_work = std::function<void(async_job&)>;
+using async_push = void (*)(lua_State* thread, async_job& job);
+
+static std::mutex io_jobs_mutex;
+static std::condition_variable io_jobs_ready;
+static std::deque<std::function<void()>> io_jobs;
+
+static void queue_io_job(std::function<void()> job) {
+    static std::once_flag started;
+    std::call_once(started, [] {
+        // IO threads mostly wait on the disk, so there can be more of them than cores
+        unsigned int count = std::thread::hardware_concurrency();
+        count = count < 4 ? 4 : count;
+        for (unsigned int i = 0; i < count; i++) {
+            std::thread([] {
+                for (;;) {
+                    std::function<void()> next;
+                    {
+                        std::unique_lock<std::mutex> lock(io_jobs_mutex);
+                        io_jobs_ready.wait(lock, [] { return !io_jobs.empty(); });
+                        next = std::move(io_jobs.front());
+                        io_jobs.pop_front();
+                    }
+                    next();
+                }
+            }).detach();
+        }
+    });
+    {
+        std::lock_guard<std::mutex> lock(io_jobs_mutex);
+        io_jobs.push_back(std::move(job));
+    }
+    io_jobs_ready.notify_one();
+}
+
+static int start_async(lua_State* thread, async_work work, async_push push) {
+    lua_pushthread(thread);
+    std::shared_ptr<async_job> job = std::make_shared<async_job>();
+    job->thread = thread;
+    job->ref = lua_ref(thread, -1);
+    lua_pop(thread, 1);
+    queue_io_job([job, work = std::move(work), push] {
+        work(*job);
+        luau::add_thread_to_resume_queue(job->thread, nullptr, 2, [job, push] {
+            lua_State* thread = job->thread;
+            lua_rawcheckstack(thread, 3);
+            if (job->error.empty()) {
+                lua_pushboolean(thread, true);
+                push(thread, *job);
+            } else {
+                lua_pushboolean(thread, false);
+                lua_pushlstring(thread, job->error.data(), job->error.size());
+            }
+            lua_unref(thread, job->ref);
+        });
+    });
+    return lua_yield(thread, 0);
+}
+static int async_continue(lua_State* thread, int status) {
+    if (!lua_toboolean(thread, -2)) {
+        lua_error(thread);
+        return 0;
+    }
+    return 1;
+}
+
+static fs::path check_async_path(lua_State* thread) {
+    size_t path_length;
+    const char* path_c_str = luaL_checklstring(thread, 1, &path_length);
+    fs::path path(std::string(path_c_str, path_length));
+    if (!is_unsafe) {
+        get_safe_path(thread, path, path);
+    }
+    return path;
+}
+static void push_nothing(lua_State* thread, async_job& job) {
+    lua_pushnil(thread);
+}
+
+int async_read_file(lua_State* thread) {
+    wanted_arg_count(1);
+    stack_slots_needed(1);
+    fs::path path = check_async_path(thread);
+    return start_async(thread, [path](async_job& job) {
+        if (fs::is_directory(path)) {
+            job.error = "Path is a directory, cannot open as a file";
+            return;
+        }
+        file_handle file;
+        file.handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        LARGE_INTEGER size;
+        if (file.handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(file.handle, &size)) {
+            job.error = "Failed to read file: " + last_error_message();
+            return;
+        }
+        job.data.resize(static_cast<size_t>(size.QuadPart));
+        if (!read_exact(file.handle, job.data.data(), job.data.size())) {
+            job.error = "Failed to read file: " + last_error_message();
+        }
+    }, [](lua_State* thread, async_job& job) {
+        lua_pushlstring(thread, job.data.data(), job.data.size());
+    });
+}
+
+int async_write_file(lua_State* thread) {
+    wanted_arg_count(2);
+    stack_slots_needed(1);
+    fs::path path = check_async_path(thread);
+    size_t content_length;
+    const char* content = luaL_checklstring(thread, 2, &content_length);
+    return start_async(thread, [path, content = std::string(content, content_length)](async_job& job) {
+        std::error_code ec;
+        fs::path parent = path.parent_path();
+        if (!parent.empty() && parent != path) {
+            fs::create_directories(parent, ec);
+        }
+        if (fs::is_directory(path, ec)) {
+            job.error = "Path is a directory, cannot open as a file";
+            return;
+        }
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            job.error = std::string("Failed to write file: ") + std::strerror(errno);
+            return;
+        }
+        file.write(content.data(), content.size());
+    }, push_nothing);
+}
+
+int async_list(lua_State* thread) {
+    wanted_arg_count(1);
+    stack_slots_needed(1);
+    fs::path path = check_async_path(thread);
+    return start_async(thread, [path](async_job& job) {
+        std::error_code ec;
+        if (!fs::is_directory(path, ec)) {
+            if (fs::exists(path, ec)) {
+                job.error = "Failed to list files: Expected folder, found file";
+            } else {
+                job.error = "Failed to list files: Nothing found at path";
+            }
+            return;
+        }
+        for (fs::directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec)) {
+            job.names.push_back(to_utf8(it->path().filename()));
+        }
+        if (ec) {
+            job.error = "Failed to list files: " + ec.message();
+        }
+    }, [](lua_State* thread, async_job& job) {
+        lua_createtable(thread, static_cast<int>(job.names.size()), 0);
+        for (size_t i = 0; i < job.names.size(); i++) {
+            lua_pushlstring(thread, job.names[i].data(), job.names[i].size());
+            lua_rawseti(thread, -2, static_cast<int>(i + 1));
+        }
+    });
+}
+
+int async_delete_file(lua_State* thread) {
+    wanted_arg_count(1);
+    stack_slots_needed(1);
+    fs::path path = check_async_path(thread);
+    return start_async(thread, [path](async_job& job) {
+        std::error_code ec;
+        if (!fs::remove(path, ec)) {
+            job.error = ec ? "Failed to delete file: " + ec.message() : "Failed to delete file: File not found";
+        }
+    }, push_nothing);
+}
+
+int async_delete_folder(lua_State* thread) {
+    wanted_arg_count(1);
+    stack_slots_needed(1);
+    fs::path path = check_async_path(thread);
+    return start_async(thread, [path](async_job& job) {
+        std::error_code ec;
+        std::uintmax_t removed = fs::remove_all(path, ec);
+        if (ec) {
+            job.error = "Failed to delete folder: " + ec.message();
+        } else if (removed == 0) {
+            job.error = "Failed to delete folder: Folder not found";
+        }
+    }, push_nothing);
+}
+
+constexpr luaL_Reg async_library[] = {
+    {"read_file", async_read_file},
+    {"write_file", async_write_file},
+    {"list", async_list},
+    {"delete_file", async_delete_file},
+    {"delete_folder", async_delete_folder},
+    {NULL, NULL}
+};
+
+// `fs.walk` lists a whole tree on several threads, reading entries the same way `list` does with `include_stats`.
+// Results are handed to the script in batches, and workers stop once a few batches are waiting, so a script that
+// stops early (or closes the walker) doesn't pay for the rest of the tree.
+constexpr const char* WALKER_TYPE = "Walker";
+constexpr size_t WALK_BATCH_SIZE = 512;
+constexpr size_t WALK_MAX_QUEUED_BATCHES = 16;
+
+struct walk_entry {
+    std::string path;
+    entry_type type;
+    uint64_t size;
+    double mtime;
+};
+struct walk_directory {
+    std::wstring path;
+    std::string display_path; // What's returned to the script, prefixed with the root as the script gave it
+    int depth;
+};
+struct walk_state {
+    std::string pattern;
+    int max_depth = INT_MAX;
+    bool follow_symlinks = false;
+    bool include_stats = false;
+    std::wstring sandbox; // Empty in unsafe mode
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<walk_directory> directories;
+    size_t busy = 0; // Workers listing a directory, which might find more
+    size_t running = 0; // Workers that haven't queued their last batch yet
+    std::deque<std::vector<walk_entry>> batches;
+    std::unordered_set<std::wstring> followed; // Canonical targets of followed symlinks, so cycles end
+    bool finished = false;
+    bool stopped = false;
+    lua_State* waiter = nullptr;
+    int waiter_ref = 0;
+
+    // Call with the mutex held. Returns the thread to resume, if any.
+    lua_State* take_waiter(int& ref) {
+        lua_State* thread = waiter;
+        ref = waiter_ref;
+        waiter = nullptr;
+        return thread;
+    }
+};
+
+static void resume_waiter(lua_State* thread, int ref) {
+    if (thread) {
+        luau::add_thread_to_resume_queue(thread, nullptr, 0, [thread, ref] {
+            lua_unref(thread, ref);
+        });
+    }
+}
+
+// `*` and `?` wildcards, matched against the entry's name
+static bool glob_match(const char* pattern, const char* name) {
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            pattern++;
+            name++;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == 0;
+}
+
+// Returns false once the walk is stopped
+static bool publish_batch(walk_state& state, std::vector<walk_entry>& batch) {
+    lua_State* waiting;
+    int ref;
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.changed.wait(lock, [&] {
+            return state.stopped || state.batches.size() < WALK_MAX_QUEUED_BATCHES;
+        });
+        if (state.stopped) {
+            return false;
+        }
+        state.batches.push_back(std::move(batch));
+        waiting = state.take_waiter(ref);
+    }
+    batch.clear();
+    batch.reserve(WALK_BATCH_SIZE);
+    resume_waiter(waiting, ref);
+    return true;
+}
+
+static bool walk_directory_entries(walk_state& state, const walk_directory& directory, std::vector<walk_entry>& batch) {
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileExW((directory.path + L"\\*").c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE) {
+        return true; // Unreadable folders are skipped rather than ending the walk
+    }
+    std::vector<walk_directory> found;
+    bool running = true;
+    do {
+        const wchar_t* name = data.cFileName;
+        if (is_dot_entry(name)) {
+            continue;
+        }
+        std::string utf8_name = to_utf8(name, -1);
+        utf8_name.pop_back(); // The terminator, since the length was -1
+        std::string display_path = directory.display_path + "/" + utf8_name;
+
+        entry_type type = find_data_type(data);
+        bool is_folder = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        bool is_symlink = type == entry_type::symlink;
+        if (is_folder && directory.depth < state.max_depth) {
+            std::wstring path = directory.path + L"\\" + name;
+            bool descend = !is_symlink;
+            if (is_symlink && state.follow_symlinks) {
+                std::error_code ec;
+                fs::path target = fs::weakly_canonical(path, ec);
+                // Safe mode can't follow links out of the sandbox
+                descend = !ec && (state.sandbox.empty() || is_inside_sandbox(target.native(), state.sandbox));
+                if (descend) {
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    descend = state.followed.insert(target.native()).second;
+                }
+            }
+            if (descend) {
+                found.push_back({.path = std::move(path), .display_path = display_path, .depth = directory.depth + 1});
+            }
+        }
+
+        if (!state.pattern.empty() && !glob_match(state.pattern.c_str(), utf8_name.c_str())) {
+            continue;
+        }
+        batch.push_back({
+            .path = std::move(display_path),
+            .type = type,
+            .size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow,
+            .mtime = filetime_to_unix(data.ftLastWriteTime),
+        });
+        if (batch.size() >= WALK_BATCH_SIZE && !publish_batch(state, batch)) {
+            running = false;
+            break;
+        }
+    } while (FindNextFileW(find, &data));
+    FindClose(find);
+
+    if (!found.empty()) {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (walk_directory& child : found) {
+            state.directories.push_back(std::move(child));
+        }
+        state.changed.notify_all();
+    }
+    return running;
+}
+
+static void walk_worker(std::shared_ptr<walk_state> state) {
+    std::vector<walk_entry> batch;
+    batch.reserve(WALK_BATCH_SIZE);
+    for (;;) {
+        walk_directory directory;
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->changed.wait(lock, [&] {
+                return state->stopped || !state->directories.empty() || state->busy == 0;
+            });
+            if (state->stopped) {
+                return;
+            }
+            if (state->directories.empty()) {
+                break; // Nothing left and nobody listing anything that could add more
+            }
+            directory = std::move(state->directories.front());
+            state->directories.pop_front();
+            state->busy++;
+        }
+        bool running = walk_directory_entries(*state, directory, batch);
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->busy--;
+        }
+        state->changed.notify_all();
+        if (!running) {
+            return;
+        }
+    }
+
+    if (!batch.empty() && !publish_batch(*state, batch)) {
+        return;
+    }
+    lua_State* waiting = nullptr;
+    int ref;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        // The last worker out marks the walk finished, once every batch is queued
+        if (--state->running == 0) {
+            state->finished = true;
+            waiting = state->take_waiter(ref);
+        }
+    }
+    resume_waiter(waiting, ref);
+}
+
+struct walker {
+    std::shared_ptr<walk_state> state;
+
+    ~walker() {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopped = true;
+        state->changed.notify_all();
+    }
+};
+
+static walk_state& check_walker(lua_State* thread, int arg) {
+    return *static_cast<walker*>(luaL_checkudata(thread, arg, WALKER_TYPE))->state;
+}
+
+static void push_walk_batch(lua_State* thread, const walk_state& state, const std::vector<walk_entry>& batch) {
+    lua_createtable(thread, static_cast<int>(batch.size()), 0);
+    for (size_t i = 0; i < batch.size(); i++) {
+        const walk_entry& entry = batch[i];
+        lua_createtable(thread, 0, state.include_stats ? 4 : 2);
+        lua_pushlstring(thread, entry.path.data(), entry.path.size());
+        lua_setfield(thread, -2, "path");
+        lua_pushstring(thread, ENTRY_TYPE_NAMES[static_cast<int>(entry.type)]);
+        lua_setfield(thread, -2, "type");
+        if (state.include_stats) {
+            lua_pushnumber(thread, static_cast<double>(entry.size));
+            lua_setfield(thread, -2, "size");
+            lua_pushnumber(thread, entry.mtime);
+            lua_setfield(thread, -2, "mtime");
+        }
+        lua_rawseti(thread, -2, static_cast<int>(i + 1));
+    }
+}
+
+// walker:next() -> {{path, type, size?, mtime?}}?
+// Yields until the next batch is ready. Returns nil once everything has been returned or the walker is closed.
+int walker_next(lua_State* thread) {
+    stack_slots_needed(4);
+    walk_state& state = check_walker(thread, 1);
+    std::vector<walk_entry> batch;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (!state.batches.empty()) {
+            batch = std::move(state.batches.front());
+            state.batches.pop_front();
+            state.changed.notify_all();
+        } else if (state.finished || state.stopped) {
+            lua_pushnil(thread);
+            return 1;
+        } else if (state.waiter) {
+            lua_pushstring(thread, "Walker is already being waited on by another thread");
+            lua_error(thread);
+            return 0;
+        } else {
+            lua_pushthread(thread);
+            state.waiter = thread;
+            state.waiter_ref = lua_ref(thread, -1);
+            lua_pop(thread, 1);
+            return lua_yield(thread, 0);
+        }
+    }
+    push_walk_batch(thread, state, batch);
+    return 1;
+}
+// Resumed once a batch is queued or the walk finished or was closed. Another coroutine can take that batch first, in which case this waits again.
+static int walker_next_continue(lua_State* thread, int status) {
+    lua_settop(thread, 1);
+    return walker_next(thread);
+}
+
+int walker_close(lua_State* thread) {
+    walk_state& state = check_walker(thread, 1);
+    lua_State* waiting;
+    int ref;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stopped = true;
+        waiting = state.take_waiter(ref);
+    }
+    state.changed.notify_all();
+    resume_waiter(waiting, ref);
+    return 0;
+}
+
+// walk(root, {pattern, max_depth, follow_symlinks, include_stats}) -> Walker
+int walk(lua_State* thread) {
+    wanted_arg_count(1);
+    stack_slots_needed(2);
+
+    size_t root_length;
+    const char* root_c_str = luaL_checklstring(thread, 1, &root_length);
+    std::string display_root(root_c_str, root_length);
+    while (display_root.size() > 1 && (display_root.back() == '/' || display_root.back() == '\\')) {
+        display_root.pop_back();
+    }
+    fs::path path(display_root);
+    if (!is_unsafe) {
+        if (!get_safe_path(thread, path, path)) {
+            return 0;
+        }
+    }
+    if (!fs::is_directory(path)) {
+        if (fs::exists(path)) {
+            lua_pushstring(thread, "Failed to walk folder: Expected folder, found file");
+        } else {
+            lua_pushstring(thread, "Failed to walk folder: Nothing found at path");
+        }
+        lua_error(thread);
+        return 0;
+    }
+
+    std::shared_ptr<walk_state> state = std::make_shared<walk_state>();
+    if (lua_gettop(thread) >= 2 && !lua_isnil(thread, 2)) {
+        luaL_checktype(thread, 2, LUA_TTABLE);
+        if (lua_getfield(thread, 2, "pattern")) {
+            state->pattern = luaL_checkstring(thread, -1);
+        }
+        lua_pop(thread, 1);
+        if (lua_getfield(thread, 2, "max_depth")) {
+            state->max_depth = luaL_checkinteger(thread, -1);
+        }
+        lua_pop(thread, 1);
+        if (lua_getfield(thread, 2, "follow_symlinks")) {
+            state->follow_symlinks = luaL_checkboolean(thread, -1);
+        }
+        lua_pop(thread, 1);
+        if (lua_getfield(thread, 2, "include_stats")) {
+            state->include_stats = luaL_checkboolean(thread, -1);
+        }
+        lua_pop(thread, 1);
+    }
+    if (!is_unsafe) {
+        state->sandbox = sandbox_root.native();
+    }
+    state->directories.push_back({.path = path.native(), .display_path = display_root, .depth = 0});
+
+    walker* object = static_cast<walker*>(lua_newuserdatadtor(thread, sizeof(walker), [](void* ud) {
+        static_cast<walker*>(ud)->~walker();
+    }));
+    new (object) walker{state};
+    luaL_getmetatable(thread, WALKER_TYPE);
+    lua_setmetatable(thread, -2);
+
+    unsigned int thread_count = std::thread::hardware_concurrency();
+    thread_count = thread_count == 0 ? 1 : thread_count;
+    state->running = thread_count;
+    for (unsigned int i = 0; i < thread_count; i++) {
+        std::thread(walk_worker, state).detach();
+    }
+    return 1;
+}
+
+// `fs.watch` reads changes with ReadDirectoryChangesW on its own thread, which sleeps in the kernel until something
+// changes. Changes are collected for `debounce_ms` after the first one and merged per path (a file written
+// several times is one "modified", and one created then deleted in the same window is nothing) before they're
+// delivered to `watcher:next()` or the callback.
+//
+// In callback mode a thread with the callback on it is always kept ready, and each delivery resumes it with the
+// events and readies the next one, so callbacks run like `task.spawn` and can yield.
+constexpr const char* WATCHER_TYPE = "Watcher";
+constexpr DWORD WATCH_DEFAULT_DEBOUNCE_MS = 50;
+
+enum class watch_event_type : uint8_t {
+    created,
+    modified,
+    deleted,
+    renamed,
+    overflow, // Too much changed at once and some changes were lost, so anything could have changed
+    none, // Merged away
+};
+constexpr const char* WATCH_EVENT_NAMES[] = {"created", "modified", "deleted", "renamed", "overflow"};
+
+struct watch_event {
+    watch_event_type type;
+    std::string path;
+    std::string old_path;
+};
+struct watch_state {
+    std::wstring filter_name; // Only changes to this name when watching a single file
+    std::string display_root;
+    bool recursive = false;
+    DWORD debounce_ms = WATCH_DEFAULT_DEBOUNCE_MS;
+    HANDLE stop_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+    std::mutex mutex;
+    std::vector<watch_event> events;
+    bool closed = false;
+    bool close_called = false; // Closed by the script rather than by the folder going away
+    lua_State* waiter = nullptr;
+    int waiter_ref = 0;
+
+    // Callback mode. The refs are only touched on the VM thread.
+    bool has_callback = false;
+    bool refs_released = false;
+    lua_State* anchor = nullptr;
+    int anchor_ref = 0;
+    int callback_ref = 0;
+    int watcher_ref = 0;
+    lua_State* dispatch_thread = nullptr; // Ready to be resumed with the next events
+    int dispatch_ref = 0;
+
+    ~watch_state() {
+        CloseHandle(stop_event);
+    }
+    // Call with the mutex held
+    lua_State* take_waiter(int& ref) {
+        lua_State* thread = waiter;
+        ref = waiter_ref;
+        waiter = nullptr;
+        return thread;
+    }
+    lua_State* take_dispatch_thread(int& ref) {
+        lua_State* thread = dispatch_thread;
+        ref = dispatch_ref;
+        dispatch_thread = nullptr;
+        return thread;
+    }
+};
+
+static void push_watch_events(lua_State* thread, const std::vector<watch_event>& events) {
+    lua_rawcheckstack(thread, 3);
+    lua_createtable(thread, static_cast<int>(events.size()), 0);
+    int current = 0;
+    for (const watch_event& event : events) {
+        if (event.type == watch_event_type::none) {
+            continue;
+        }
+        lua_createtable(thread, 0, event.type == watch_event_type::renamed ? 3 : 2);
+        lua_pushstring(thread, WATCH_EVENT_NAMES[static_cast<int>(event.type)]);
+        lua_setfield(thread, -2, "type");
+        lua_pushlstring(thread, event.path.data(), event.path.size());
+        lua_setfield(thread, -2, "path");
+        if (event.type == watch_event_type::renamed) {
+            lua_pushlstring(thread, event.old_path.data(), event.old_path.size());
+            lua_setfield(thread, -2, "old_path");
+        }
+        lua_rawseti(thread, -2, ++current);
+    }
+}
+
+// VM thread only
+static void release_watch_refs(lua_State* thread, watch_state& state) {
+    if (!state.has_callback || state.refs_released) {
+        return;
+    }
+    state.refs_released = true;
+    int dispatch_ref;
+    lua_State* dispatch;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        dispatch = state.take_dispatch_thread(dispatch_ref);
+    }
+    if (dispatch) {
+        lua_unref(thread, dispatch_ref);
+    }
+    lua_unref(thread, state.callback_ref);
+    lua_unref(thread, state.watcher_ref);
+    lua_unref(thread, state.anchor_ref);
+}
+
+static void arm_watch_dispatch(std::shared_ptr<watch_state> state);
+static void queue_watch_dispatch(std::shared_ptr<watch_state> state, lua_State* dispatch, int dispatch_ref) {
+    luau::add_thread_to_resume_queue(dispatch, nullptr, 1, [state, dispatch, dispatch_ref] {
+        std::vector<watch_event> events;
+        bool closed;
+        bool close_called;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            events.swap(state->events);
+            closed = state->closed;
+            close_called = state->close_called;
+        }
+        if (events.empty() || close_called) {
+            // Only woken to clean up after closing, or queued before close() and mustn't reach the callback anymore,
+            // so run nothing instead of the callback
+            lua_settop(dispatch, 0);
+            lua_pushcfunction(dispatch, [](lua_State*) {
+                return 0;
+            }, "watch_closed");
+            lua_pushnil(dispatch);
+        } else {
+            push_watch_events(dispatch, events);
+        }
+        lua_unref(dispatch, dispatch_ref);
+        if (closed) {
+            release_watch_refs(dispatch, *state);
+        } else {
+            arm_watch_dispatch(state);
+        }
+    });
+}
+// VM thread only
+static void arm_watch_dispatch(std::shared_ptr<watch_state> state) {
+    lua_State* dispatch = luau::create_thread(state->anchor);
+    lua_rawcheckstack(dispatch, 2);
+    lua_getref(dispatch, state->callback_ref);
+    lua_pushthread(dispatch);
+    int dispatch_ref = lua_ref(dispatch, -1);
+    lua_pop(dispatch, 1);
+    bool pending;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        pending = !state->events.empty() || state->closed;
+        if (!pending) {
+            state->dispatch_thread = dispatch;
+            state->dispatch_ref = dispatch_ref;
+        }
+    }
+    if (pending) {
+        queue_watch_dispatch(state, dispatch, dispatch_ref);
+    }
+}
+
+// Hands events to whoever is waiting. With `closing`, also marks the watcher closed so waiters get nil.
+static void publish_watch_events(const std::shared_ptr<watch_state>& state, std::vector<watch_event>& events, bool closing) {
+    lua_State* waiting;
+    int waiting_ref;
+    lua_State* dispatch;
+    int dispatch_ref;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        for (watch_event& event : events) {
+            if (event.type != watch_event_type::none) {
+                state->events.push_back(std::move(event));
+            }
+        }
+        if (closing) {
+            state->closed = true;
+        }
+        if (state->events.empty() && !closing) {
+            events.clear();
+            return;
+        }
+        waiting = state->take_waiter(waiting_ref);
+        dispatch = state->take_dispatch_thread(dispatch_ref);
+    }
+    events.clear();
+    resume_waiter(waiting, waiting_ref);
+    if (dispatch) {
+        queue_watch_dispatch(state, dispatch, dispatch_ref);
+    }
+}
+
+// Merges a change into the pending ones for the same path
+static void coalesce_watch_event(std::vector<watch_event>& pending, std::unordered_map<std::string, size_t>& index, watch_event_type type, std::string path) {
+    auto it = index.find(path);
+    if (it != index.end()) {
+        watch_event& existing = pending[it->second];
+        switch (existing.type) {
+        case watch_event_type::created:
+            if (type == watch_event_type::deleted) {
+                existing.type = watch_event_type::none;
+                index.erase(it);
+            }
+            return;
+        case watch_event_type::modified:
+            if (type == watch_event_type::deleted) {
+                existing.type = watch_event_type::deleted;
+            }
+            return;
+        case watch_event_type::deleted:
+            // Recreated since, so the path still exists with new contents. Anything else leaves it deleted.
+            if (type == watch_event_type::created) {
+                existing.type = watch_event_type::modified;
+            }
+            return;
+        default:
+            break;
+        }
+    }
+    index[path] = pending.size();
+    pending.push_back({.type = type, .path = std::move(path)});
+}
+
+static bool watch_name_matches(const watch_state& state, std::wstring_view name) {
+    return state.filter_name.empty()
+        || CompareStringOrdinal(name.data(), static_cast<int>(name.size()), state.filter_name.data(), static_cast<int>(state.filter_name.size()), TRUE) == CSTR_EQUAL;
+}
+static std::string watch_event_path(const watch_state& state, std::wstring_view name) {
+    if (!state.filter_name.empty()) {
+        return state.display_root;
+    }
+    std::string path = state.display_root + "/" + to_utf8(name.data(), static_cast<int>(name.size()));
+    std::replace(path.begin(), path.end(), '\\', '/');
+    return path;
+}
+
+static void watch_reader(std::shared_ptr<watch_state> state, HANDLE directory) {
+    std::vector<DWORD> buffer(16 * 1024); // ReadDirectoryChangesW needs DWORD alignment
+    constexpr DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE
+        | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_CREATION;
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    HANDLE waits[] = {overlapped.hEvent, state->stop_event};
+
+    std::vector<watch_event> pending;
+    std::unordered_map<std::string, size_t> pending_index;
+    ULONGLONG first_change = 0;
+    std::string rename_from;
+    bool rename_from_matched = false;
+    bool reading = false;
+    bool stopped = false;
+    for (;;) {
+        if (!reading) {
+            ResetEvent(overlapped.hEvent);
+            if (!ReadDirectoryChangesW(directory, buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(DWORD)), state->recursive, filter, NULL, &overlapped, NULL)) {
+                break;
+            }
+            reading = true;
+        }
+
+        DWORD timeout = INFINITE;
+        if (!pending.empty()) {
+            ULONGLONG elapsed = GetTickCount64() - first_change;
+            timeout = elapsed >= state->debounce_ms ? 0 : static_cast<DWORD>(state->debounce_ms - elapsed);
+        }
+        DWORD result = WaitForMultipleObjects(2, waits, FALSE, timeout);
+        if (result == WAIT_TIMEOUT) {
+            publish_watch_events(state, pending, false);
+            pending_index.clear();
+            continue;
+        } else if (result != WAIT_OBJECT_0) {
+            stopped = result == WAIT_OBJECT_0 + 1;
+            break;
+        }
+
+        reading = false;
+        DWORD bytes;
+        if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE)) {
+            break; // The folder was deleted or the handle otherwise went bad
+        }
+        if (pending.empty()) {
+            first_change = GetTickCount64();
+        }
+        if (bytes == 0) {
+            pending.push_back({.type = watch_event_type::overflow, .path = state->display_root});
+            continue;
+        }
+        const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer.data());
+        for (;;) {
+            std::wstring_view name(info->FileName, info->FileNameLength / sizeof(wchar_t));
+            bool matched = watch_name_matches(*state, name);
+            switch (info->Action) {
+            case FILE_ACTION_ADDED:
+                if (matched) {
+                    coalesce_watch_event(pending, pending_index, watch_event_type::created, watch_event_path(*state, name));
+                }
+                break;
+            case FILE_ACTION_MODIFIED:
+                if (matched) {
+                    coalesce_watch_event(pending, pending_index, watch_event_type::modified, watch_event_path(*state, name));
+                }
+                break;
+            case FILE_ACTION_REMOVED:
+                if (matched) {
+                    coalesce_watch_event(pending, pending_index, watch_event_type::deleted, watch_event_path(*state, name));
+                }
+                break;
+            case FILE_ACTION_RENAMED_OLD_NAME:
+                rename_from = watch_event_path(*state, name);
+                rename_from_matched = matched;
+                break;
+            case FILE_ACTION_RENAMED_NEW_NAME:
+                // A single watched file renamed to or from its name looks like it was created or deleted
+                if (matched && rename_from_matched) {
+                    std::string path = watch_event_path(*state, name);
+                    pending_index.erase(path);
+                    pending_index.erase(rename_from);
+                    pending.push_back({.type = watch_event_type::renamed, .path = std::move(path), .old_path = std::move(rename_from)});
+                } else if (matched) {
+                    coalesce_watch_event(pending, pending_index, watch_event_type::created, watch_event_path(*state, name));
+                } else if (rename_from_matched) {
+                    coalesce_watch_event(pending, pending_index, watch_event_type::deleted, std::move(rename_from));
+                }
+                rename_from.clear();
+                rename_from_matched = false;
+                break;
+            }
+            if (info->NextEntryOffset == 0) {
+                break;
+            }
+            info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(reinterpret_cast<const char*>(info) + info->NextEntryOffset);
+        }
+    }
+
+    if (reading) {
+        DWORD bytes;
+        CancelIoEx(directory, &overlapped);
+        GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+    }
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(directory);
+    if (!stopped) {
+        publish_watch_events(state, pending, true);
+    }
+}
+
+struct watcher {
+    std::shared_ptr<watch_state> state;
+
+    ~watcher() {
+        SetEvent(state->stop_event);
+    }
+};
+
+static watch_state& check_watcher(lua_State* thread, int arg) {
+    return *static_cast<watcher*>(luaL_checkudata(thread, arg, WATCHER_TYPE))->state;
+}
+
+// watcher:next() -> {{type, path, old_path?}}?
+// Yields until there are events. Returns nil once the watcher is closed or the folder is gone.
+int watcher_next(lua_State* thread) {
+    stack_slots_needed(4);
+    watch_state& state = check_watcher(thread, 1);
+    std::vector<watch_event> events;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.has_callback) {
+            lua_pushstring(thread, "Watcher delivers its events to its callback");
+            lua_error(thread);
+            return 0;
+        } else if (!state.events.empty()) {
+            events.swap(state.events);
+        } else if (state.closed) {
+            lua_pushnil(thread);
+            return 1;
+        } else if (state.waiter) {
+            lua_pushstring(thread, "Watcher is already being waited on by another thread");
+            lua_error(thread);
+            return 0;
+        } else {
+            lua_pushthread(thread);
+            state.waiter = thread;
+            state.waiter_ref = lua_ref(thread, -1);
+            lua_pop(thread, 1);
+            return lua_yield(thread, 0);
+        }
+    }
+    push_watch_events(thread, events);
+    return 1;
+}
+// Resumed once there are events or the watcher closed. Another coroutine can take those events first, in which case this waits again.
+static int watcher_next_continue(lua_State* thread, int status) {
+    lua_settop(thread, 1);
+    return watcher_next(thread);
+}
+
+int watcher_close(lua_State* thread) {
+    watch_state& state = check_watcher(thread, 1);
+    lua_State* waiting;
+    int ref;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.closed = true;
+        state.close_called = true;
+        waiting = state.take_waiter(ref);
+    }
+    SetEvent(state.stop_event);
+    resume_waiter(waiting, ref);
+    release_watch_refs(thread, state);
+    return 0;
+}
+
+// watch(path, {recursive, debounce_ms}, callback) -> Watcher
+// Watching a file watches its folder for changes to just that file. With a callback, the watcher keeps running
+// until it's closed even if nothing references it.
+int watch(lua_State* thread) {
+    wanted_arg_count(1);
+    stack_slots_needed(3);
+
+    size_t path_length;
+    const char* path_c_str = luaL_checklstring(thread, 1, &path_length);
+    std::string display_root(path_c_str, path_length);
+    while (display_root.size() > 1 && (display_root.back() == '/' || display_root.back() == '\\')) {
+        display_root.pop_back();
+    }
+    fs::path path(display_root);
+    if (!is_unsafe) {
+        if (!get_safe_path(thread, path, path)) {
+            return 0;
+        }
+    }
+
+    std::shared_ptr<watch_state> state = std::make_shared<watch_state>();
+    state->display_root = display_root;
+    if (lua_gettop(thread) >= 2 && !lua_isnil(thread, 2)) {
+        luaL_checktype(thread, 2, LUA_TTABLE);
+        if (lua_getfield(thread, 2, "recursive")) {
+            state->recursive = luaL_checkboolean(thread, -1);
+        }
+        lua_pop(thread, 1);
+        if (lua_getfield(thread, 2, "debounce_ms")) {
+            state->debounce_ms = luaL_checkunsigned(thread, -1);
+        }
+        lua_pop(thread, 1);
+    }
+    bool has_callback = lua_gettop(thread) >= 3 && !lua_isnil(thread, 3);
+    if (has_callback) {
+        luaL_checktype(thread, 3, LUA_TFUNCTION);
+    }
+
+    std::error_code ec;
+    fs::path directory = path;
+    if (fs::is_regular_file(path, ec)) {
+        directory = path.parent_path();
+        state->filter_name = path.filename().native();
+        state->recursive = false;
+    } else if (!fs::is_directory(path, ec)) {
+        lua_pushstring(thread, "Failed to watch: Nothing found at path");
+        lua_error(thread);
+        return 0;
+    }
+
+    // Allocated before opening the folder so a failed allocation can't leak the handle
+    watcher* object = static_cast<watcher*>(lua_newuserdatadtor(thread, sizeof(watcher), [](void* ud) {
+        static_cast<watcher*>(ud)->~watcher();
+    }));
+    new (object) watcher{state};
+    luaL_getmetatable(thread, WATCHER_TYPE);
+    lua_setmetatable(thread, -2);
+
+    file_handle directory_handle;
+    directory_handle.handle = CreateFileW(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (directory_handle.handle == INVALID_HANDLE_VALUE) {
+        lua_pushfstring(thread, "Failed to watch: %s", last_error_message().c_str());
+        lua_error(thread);
+        return 0;
+    }
+
+    if (has_callback) {
+        state->has_callback = true;
+        state->anchor = luau::create_thread(thread);
+        lua_pushthread(state->anchor);
+        state->anchor_ref = lua_ref(state->anchor, -1);
+        lua_pop(state->anchor, 1);
+        state->callback_ref = lua_ref(thread, 3);
+        state->watcher_ref = lua_ref(thread, -1);
+        arm_watch_dispatch(state);
+    }
+    std::thread(watch_reader, state, directory_handle.handle).detach();
+    directory_handle.handle = INVALID_HANDLE_VALUE; // The reader closes it now
+    return 1;
+}
+
+static void register_type(lua_State* thread, const char* name, const luaL_Reg* methods) {
+    luaL_newmetatable(thread, name);
+    lua_newtable(thread);
+    luaL_register(thread, NULL, methods);
+    lua_setfield(thread, -2, "__index");
+    lua_pushstring(thread, name);
+    lua_setfield(thread, -2, "__type");
+    lua_pop(thread, 1);
+}
+
+#define reg(name) {#name, name}
+constexpr luaL_Reg library[] = {
+    reg(read_file),
+    reg(read_buffer),
+    reg(write_file),
+    reg(append_file),
+    reg(exists),
+    reg(is_file),
+    reg(is_folder),
+    reg(list),
+    reg(new_folder),
+    reg(delete_file),
+    reg(delete_folder),
+    {"open", open_file},
+    reg(walk),
+    reg(watch),
+    {NULL, NULL}
+};
+
+extern "C" __declspec(dllexport) void register_library(lua_State* thread) {
+    luaL_register(thread, "fs", library);
+    lua_createtable(thread, 0, sizeof(async_library) / sizeof(luaL_Reg) - 1);
+    for (const luaL_Reg* function = async_library; function->name; function++) {
+        lua_pushcclosurek(thread, function->func, function->name, 0, async_continue);
+        lua_setfield(thread, -2, function->name);
+    }
+    lua_setfield(thread, -2, "async");
+
+    register_type(thread, FILE_HANDLE_TYPE, file_methods);
+
+    luaL_newmetatable(thread, WALKER_TYPE);
+    lua_createtable(thread, 0, 2);
+    lua_pushcclosurek(thread, walker_next, "next", 0, walker_next_continue);
+    lua_setfield(thread, -2, "next");
+    lua_pushcfunction(thread, walker_close, "close");
+    lua_setfield(thread, -2, "close");
+    lua_setfield(thread, -2, "__index");
+    lua_pushstring(thread, WALKER_TYPE);
+    lua_setfield(thread, -2, "__type");
+    lua_pop(thread, 1);
+
+    luaL_newmetatable(thread, WATCHER_TYPE);
+    lua_createtable(thread, 0, 2);
+    lua_pushcclosurek(thread, watcher_next, "next", 0, watcher_next_continue);
+    lua_setfield(thread, -2, "next");
+    lua_pushcfunction(thread, watcher_close, "close");
+    lua_setfield(thread, -2, "close");
+    lua_setfield(thread, -2, "__index");
+    lua_pushstring(thread, WATCHER_TYPE);
+    lua_setfield(thread, -2, "__type");
+    lua_pop(thread, 1);
+
+    is_unsafe = luau::is_plugin_loaded("runluau-osunsafe.dll");
+    if (!is_unsafe) {
+        update_sandbox_root();
+    }
 }
@@ -0,0 +1,403 @@
+#include "pch.h"
+
+#include "analysis.h"
+#include "util.h"
+
+constexpr const char* CHECK_SESSION_KEY = "runluau-luau-check-session";
+
+// Sources passed to `check` take priority over the disk, so an editor can check unsaved buffers
+struct check_file_resolver : Luau::FileResolver {
+	std::unordered_map<std::string, std::string> sources;
+
+	std::optional<std::string> read_disk(const std::string& name) {
+		std::filesystem::path path(name);
+		if (!resolve_sandbox_path(path)) {
+			return std::nullopt;
+		}
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) {
+			return std::nullopt;
+		}
+		std::string source(static_cast<size_t>(file.tellg()), '\0');
+		file.seekg(0);
+		file.read(source.data(), source.size());
+		return source;
+	}
+	bool exists(const std::string& name) {
+		if (sources.contains(name)) {
+			return true;
+		}
+		std::filesystem::path path(name);
+		std::error_code error;
+		return resolve_sandbox_path(path) && std::filesystem::is_regular_file(path, error);
+	}
+
+	std::optional<Luau::SourceCode> readSource(const Luau::ModuleName& name) override {
+		auto it = sources.find(name);
+		if (it != sources.end()) {
+			return Luau::SourceCode{it->second, Luau::SourceCode::Module};
+		}
+		std::optional<std::string> source = read_disk(name);
+		if (!source) {
+			return std::nullopt;
+		}
+		return Luau::SourceCode{std::move(*source), Luau::SourceCode::Module};
+	}
+	// `require("x")` resolves relative to the requiring module, trying `x`, `x.luau`, `x.lua` and `x/init.luau`
+	std::optional<Luau::ModuleInfo> resolveModule(const Luau::ModuleInfo* context, Luau::AstExpr* expr) override {
+		Luau::AstExprConstantString* string = expr->as<Luau::AstExprConstantString>();
+		if (!string) {
+			return std::nullopt;
+		}
+		std::filesystem::path base(std::string(string->value.data, string->value.size));
+		if (context) {
+			base = std::filesystem::path(context->name).parent_path() / base;
+		}
+		std::string name = base.lexically_normal().generic_string();
+		for (const char* suffix : MODULE_SUFFIXES) {
+			std::string candidate = name + suffix;
+			if (exists(candidate)) {
+				return Luau::ModuleInfo{candidate};
+			}
+		}
+		return Luau::ModuleInfo{name};
+	}
+};
+
+struct check_session {
+	check_file_resolver file_resolver;
+	Luau::NullConfigResolver config_resolver;
+	Luau::Frontend frontend;
+
+	check_session() : frontend(&file_resolver, &config_resolver) {
+		Luau::registerBuiltinGlobals(frontend, frontend.globals);
+		Luau::freeze(frontend.globals.globalTypes);
+	}
+};
+// The session lives as long as the VM, so modules that didn't change are never checked twice
+check_session& get_check_session(lua_State* thread) {
+	stack_slots_needed(1);
+	lua_getfield(thread, LUA_REGISTRYINDEX, CHECK_SESSION_KEY);
+	check_session* session = static_cast<check_session*>(lua_touserdata(thread, -1));
+	lua_pop(thread, 1);
+	if (!session) {
+		void* memory = lua_newuserdatadtor(thread, sizeof(check_session), destroy_userdata<check_session>);
+		session = new (memory) check_session();
+		lua_setfield(thread, LUA_REGISTRYINDEX, CHECK_SESSION_KEY);
+	}
+	return *session;
+}
+
+Luau::Mode check_mode(lua_State* thread, int arg) {
+	std::string mode = luaL_checkstring(thread, arg);
+	if (mode == "strict") {
+		return Luau::Mode::Strict;
+	} else if (mode == "nonstrict") {
+		return Luau::Mode::Nonstrict;
+	} else if (mode == "nocheck") {
+		return Luau::Mode::NoCheck;
+	}
+	lua_pushstring(thread, "mode must be \"strict\", \"nonstrict\" or \"nocheck\"");
+	lua_error(thread);
+	return Luau::Mode::Strict;
+}
+
+// check({[name] = source | true}, options) -> {[name] = {{module, message, location}}}
+// A source string replaces the module's in-memory source, and `true` checks the module as it is on disk.
+int check(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(6);
+	luaL_checktype(thread, 1, LUA_TTABLE);
+	check_session& session = get_check_session(thread);
+	Luau::Frontend& frontend = session.frontend;
+
+	if (lua_gettop(thread) >= 2 && !lua_isnil(thread, 2)) {
+		luaL_checktype(thread, 2, LUA_TTABLE);
+		if (lua_getfield(thread, 2, "mode")) {
+			Luau::Mode mode = check_mode(thread, -1);
+			if (mode != session.config_resolver.defaultConfig.mode) {
+				session.config_resolver.defaultConfig.mode = mode;
+				frontend.clear();
+			}
+		}
+		lua_pop(thread, 1);
+		// Modules read from disk that changed since the last call
+		if (lua_getfield(thread, 2, "dirty")) {
+			luaL_checktype(thread, -1, LUA_TTABLE);
+			for (int i = 0; i = lua_rawiter(thread, -1, i), i >= 0;) {
+				frontend.markDirty(luaL_checkstring(thread, -1));
+				lua_pop(thread, 2);
+			}
+		}
+		lua_pop(thread, 1);
+	}
+
+	std::vector<std::string> names;
+	for (int i = 0; i = lua_rawiter(thread, 1, i), i >= 0;) {
+		std::string name = luaL_checkstring(thread, -2);
+		if (lua_type(thread, -1) == LUA_TSTRING) {
+			size_t length;
+			const char* source = lua_tolstring(thread, -1, &length);
+			auto it = session.file_resolver.sources.find(name);
+			if (it == session.file_resolver.sources.end() || it->second != std::string_view(source, length)) {
+				session.file_resolver.sources[name] = std::string(source, length);
+				frontend.markDirty(name);
+			}
+		} else if (lua_type(thread, -1) == LUA_TBOOLEAN) {
+			if (session.file_resolver.sources.erase(name)) {
+				frontend.markDirty(name);
+			}
+		} else {
+			lua_pushstring(thread, "Expected check's files to map module names to a source string or true");
+			lua_error(thread);
+			return 0;
+		}
+		names.push_back(std::move(name));
+		lua_pop(thread, 2);
+	}
+
+	lua_createtable(thread, 0, static_cast<int>(names.size()));
+	for (const std::string& name : names) {
+		Luau::CheckResult result = frontend.check(name);
+		luau::pushstring(thread, name);
+		lua_createtable(thread, static_cast<int>(result.errors.size()), 0);
+		int current = 0;
+		for (const Luau::TypeError& error : result.errors) {
+			lua_createtable(thread, 0, 3);
+			luau::pushstring(thread, error.moduleName);
+			lua_setfield(thread, -2, "module");
+			luau::pushstring(thread, Luau::toString(error));
+			lua_setfield(thread, -2, "message");
+			set_location(thread, error.location);
+			lua_rawseti(thread, -2, ++current);
+		}
+		lua_rawset(thread, -3);
+	}
+	return 1;
+}
+
+struct lint_file {
+	std::string name;
+	std::string_view source;
+	std::vector<Luau::ParseError> errors;
+	std::vector<Luau::LintWarning> warnings;
+};
+void set_lint_codes(lua_State* thread, int arg, const char* field, Luau::LintOptions& options, bool enable) {
+	if (lua_getfield(thread, arg, field)) {
+		luaL_checktype(thread, -1, LUA_TTABLE);
+		for (int i = 0; i = lua_rawiter(thread, -1, i), i >= 0;) {
+			const char* name = luaL_checkstring(thread, -1);
+			Luau::LintWarning::Code code = Luau::LintWarning::parseName(name);
+			if (code == Luau::LintWarning::Code_Unknown) {
+				lua_pushfstring(thread, "Unknown lint \"%s\"", name);
+				lua_error(thread);
+			}
+			if (enable) {
+				options.enableWarning(code);
+			} else {
+				options.disableWarning(code);
+			}
+			lua_pop(thread, 2);
+		}
+	}
+	lua_pop(thread, 1);
+}
+
+// lint({[name] = source}, config) -> {[name] = {warnings = {...}, errors = {...}}}
+// Files don't depend on each other, so they're parsed and linted on as many threads as there are cores.
+int lint(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(6);
+	luaL_checktype(thread, 1, LUA_TTABLE);
+	Luau::ParseOptions parse_options;
+	Luau::LintOptions lint_options;
+	lint_options.setDefaults();
+	if (lua_gettop(thread) >= 2 && !lua_isnil(thread, 2)) {
+		check_parse_options(thread, 2, parse_options);
+		if (lua_getfield(thread, 2, "all")) {
+			if (luaL_checkboolean(thread, -1)) {
+				lint_options.warningMask = ~0ull;
+			}
+		}
+		lua_pop(thread, 1);
+		set_lint_codes(thread, 2, "enabled", lint_options, true);
+		set_lint_codes(thread, 2, "disabled", lint_options, false);
+	}
+
+	std::vector<lint_file> files;
+	for (int i = 0; i = lua_rawiter(thread, 1, i), i >= 0;) {
+		// Only the table keeps the source alive, and a number would be converted into a string nothing references
+		const char* name = luaL_checkstring(thread, -2);
+		if (lua_type(thread, -1) != LUA_TSTRING) {
+			lua_pushfstring(thread, "Source of \"%s\" must be a string, got %s", name, luaL_typename(thread, -1));
+			lua_error(thread);
+			return 0;
+		}
+		size_t length;
+		const char* source = lua_tolstring(thread, -1, &length);
+		files.push_back({.name = name, .source = std::string_view(source, length)});
+		lua_pop(thread, 2);
+	}
+
+	// Builtin globals stop `UnknownGlobal` from flagging things like `print`. The scope is frozen, so sharing it between workers is fine.
+	const Luau::ScopePtr& env = get_check_session(thread).frontend.globals.globalScope;
+	run_parallel(files.size(), [&](size_t index) {
+		lint_file& file = files[index];
+		Luau::Allocator allocator;
+		Luau::AstNameTable names(allocator);
+		Luau::ParseResult parsed = Luau::Parser::parse(file.source.data(), file.source.size(), names, allocator, parse_options);
+		if (parsed.root) {
+			file.warnings = Luau::lint(parsed.root, names, env, nullptr, parsed.hotcomments, lint_options);
+		}
+		file.errors = std::move(parsed.errors);
+	});
+
+	lua_createtable(thread, 0, static_cast<int>(files.size()));
+	for (const lint_file& file : files) {
+		luau::pushstring(thread, file.name);
+		lua_createtable(thread, 0, 2);
+
+		lua_createtable(thread, static_cast<int>(file.warnings.size()), 0);
+		int current = 0;
+		for (const Luau::LintWarning& warning : file.warnings) {
+			lua_createtable(thread, 0, 4);
+			lua_pushinteger(thread, warning.code);
+			lua_setfield(thread, -2, "code");
+			lua_pushstring(thread, Luau::LintWarning::getName(warning.code));
+			lua_setfield(thread, -2, "name");
+			luau::pushstring(thread, warning.text);
+			lua_setfield(thread, -2, "message");
+			set_location(thread, warning.location);
+			lua_rawseti(thread, -2, ++current);
+		}
+		lua_setfield(thread, -2, "warnings");
+
+		lua_createtable(thread, static_cast<int>(file.errors.size()), 0);
+		current = 0;
+		for (const Luau::ParseError& error : file.errors) {
+			lua_createtable(thread, 0, 2);
+			luau::pushstring(thread, error.getMessage());
+			lua_setfield(thread, -2, "message");
+			set_location(thread, error.getLocation());
+			lua_rawseti(thread, -2, ++current);
+		}
+		lua_setfield(thread, -2, "errors");
+
+		lua_rawset(thread, -3);
+	}
+	return 1;
+}
+
+
+struct dependency_file {
+	std::string name;
+	std::filesystem::path path;
+	std::vector<std::string> dependencies;
+	std::string error;
+};
+// Only the token stream is needed to find `require("x")` and `require "x"`, so files are lexed
+// rather than parsed and no AST is ever allocated. Calls with non-literal paths, or paths with escapes, are skipped.
+void find_requires(std::string_view source, std::vector<std::string>& out) {
+	Luau::Allocator allocator;
+	Luau::AstNameTable names(allocator);
+	const char* require = names.getOrAdd("require").value;
+	Luau::Lexer lexer(source.data(), source.size(), names);
+	lexer.setSkipComments(true);
+	Luau::Lexeme::Type previous = Luau::Lexeme::Eof;
+	for (;;) {
+		const Luau::Lexeme& lexeme = lexer.next();
+		if (lexeme.type == Luau::Lexeme::Eof) {
+			break;
+		}
+		// `x.require(...)` and `x:require(...)` are somebody else's method
+		bool is_require = lexeme.type == Luau::Lexeme::Name && lexeme.name == require && previous != '.' && previous != ':';
+		previous = lexeme.type;
+		if (!is_require) {
+			continue;
+		}
+		const Luau::Lexeme* argument = &lexer.next();
+		if (argument->type == '(') {
+			argument = &lexer.next();
+		}
+		previous = argument->type;
+		if (argument->type == Luau::Lexeme::RawString) {
+			out.emplace_back(argument->data, argument->getLength());
+		} else if (argument->type == Luau::Lexeme::QuotedString || argument->type == Luau::Lexeme::InterpStringSimple) {
+			// Lexemes hold the source text, so escapes would come out undecoded
+			std::string_view path(argument->data, argument->getLength());
+			if (path.find('\\') == std::string_view::npos) {
+				out.emplace_back(path);
+			}
+		}
+	}
+}
+
+// dependencies({name}) -> {[name] = {dependency}}, {[name] = error}
+// Dependencies are resolved the same way `check` and `loader` resolve them. Files are read, lexed
+// and resolved in parallel.
+int dependencies(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(5);
+	luaL_checktype(thread, 1, LUA_TTABLE);
+	bool unsafe = luau::is_plugin_loaded("runluau-osunsafe.dll");
+	std::vector<dependency_file> files(lua_objlen(thread, 1));
+	for (size_t i = 0; i < files.size(); i++) {
+		lua_rawgeti(thread, 1, static_cast<int>(i + 1));
+		files[i].name = luaL_checkstring(thread, -1);
+		files[i].path = files[i].name;
+		lua_pop(thread, 1);
+	}
+
+	run_parallel(files.size(), [&](size_t index) {
+		dependency_file& file = files[index];
+		if (!resolve_sandbox_path(file.path, unsafe)) {
+			file.error = "Filesystem safe mode: Path traversal detected";
+			return;
+		}
+		std::ifstream stream(file.path, std::ios::binary | std::ios::ate);
+		if (!stream) {
+			file.error = "Failed to open file";
+			return;
+		}
+		std::string source(static_cast<size_t>(stream.tellg()), '\0');
+		stream.seekg(0);
+		stream.read(source.data(), source.size());
+		std::vector<std::string> requests;
+		find_requires(source, requests);
+
+		std::filesystem::path directory = std::filesystem::path(file.name).parent_path();
+		for (const std::string& request : requests) {
+			std::string stem = (directory / request).lexically_normal().generic_string();
+			std::string resolved = stem;
+			for (const char* suffix : MODULE_SUFFIXES) {
+				std::filesystem::path candidate(stem + suffix);
+				std::error_code error;
+				if (resolve_sandbox_path(candidate, unsafe) && std::filesystem::is_regular_file(candidate, error)) {
+					resolved = stem + suffix;
+					break;
+				}
+			}
+			if (std::find(file.dependencies.begin(), file.dependencies.end(), resolved) == file.dependencies.end()) {
+				file.dependencies.push_back(std::move(resolved));
+			}
+		}
+	});
+
+	lua_createtable(thread, 0, static_cast<int>(files.size()));
+	lua_newtable(thread);
+	for (const dependency_file& file : files) {
+		luau::pushstring(thread, file.name);
+		if (!file.error.empty()) {
+			luau::pushstring(thread, file.error);
+			lua_rawset(thread, -3);
+			continue;
+		}
+		lua_createtable(thread, static_cast<int>(file.dependencies.size()), 0);
+		for (size_t i = 0; i < file.dependencies.size(); i++) {
+			luau::pushstring(thread, file.dependencies[i]);
+			lua_rawseti(thread, -2, static_cast<int>(i + 1));
+		}
+		lua_rawset(thread, -4);
+	}
+	return 2;
+}
\ No newline at end of file
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "luau.h"
+
+int check(lua_State* thread);
+int lint(lua_State* thread);
+int dependencies(lua_State* thread);
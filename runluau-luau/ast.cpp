@@ -0,0 +1,659 @@
+#include "pch.h"
+
+#include "ast.h"
+#include "util.h"
+
+Luau::Location ast_location_map::apply(Luau::Location location) const {
+	for (const auto& [from, to] : replacements) {
+		if (from == location) {
+			return to;
+		}
+	}
+	auto move = [&](Luau::Position& position) {
+		if (position.line == first_line) {
+			position.column += columns;
+		}
+		position.line += lines;
+	};
+	move(location.begin);
+	move(location.end);
+	return location;
+}
+
+// Pushes nodes as tables shaped like the objects `Luau::toJson` writes, straight from the AST so locations
+// never get formatted and parsed back. Every visit pushes exactly one value.
+struct ast_pusher : Luau::AstVisitor {
+	lua_State* thread;
+	const ast_location_map* map;
+
+	ast_pusher(lua_State* thread, const ast_location_map* map) : thread(thread), map(map) {}
+
+	void push(bool value) {
+		lua_pushboolean(thread, value);
+	}
+	void push(int value) {
+		lua_pushinteger(thread, value);
+	}
+	void push(unsigned int value) {
+		lua_pushunsigned(thread, value);
+	}
+	void push(double value) {
+		// toJson writes these as bare words, which have always come out as strings
+		if (std::isnan(value)) {
+			lua_pushstring(thread, "NaN");
+		} else if (std::isinf(value)) {
+			lua_pushstring(thread, value > 0 ? "Infinity" : "-Infinity");
+		} else {
+			lua_pushnumber(thread, value);
+		}
+	}
+	void push(const char* string) {
+		lua_pushstring(thread, string);
+	}
+	void push(const Luau::AstArray<char>& string) {
+		lua_pushlstring(thread, string.data, string.size);
+	}
+	void push(Luau::AstName name) {
+		if (name.value) {
+			lua_pushstring(thread, name.value);
+		} else {
+			lua_pushnil(thread);
+		}
+	}
+	void push(Luau::Location location) {
+		push_location(thread, map ? map->apply(location) : location);
+	}
+	void push(Luau::AstNode* node) {
+		if (node) {
+			node->visit(this);
+		} else {
+			lua_pushnil(thread);
+		}
+	}
+	void push(Luau::AstLocal* local) {
+		lua_createtable(thread, 0, 4);
+		set("type", "AstLocal");
+		set("location", local->location);
+		set("name", local->name);
+		set("luauType", local->annotation);
+	}
+	void push(const Luau::AstTypeList& list) {
+		lua_createtable(thread, 0, 3);
+		set("type", "AstTypeList");
+		set("types", list.types);
+		if (list.tailType) {
+			set("tailType", list.tailType);
+		}
+	}
+	void push(const Luau::AstExprTable::Item& item) {
+		lua_createtable(thread, 0, 4);
+		set("type", "AstExprTableItem");
+		switch (item.kind) {
+		case Luau::AstExprTable::Item::List: set("kind", "item"); break;
+		case Luau::AstExprTable::Item::Record: set("kind", "record"); break;
+		case Luau::AstExprTable::Item::General: set("kind", "general"); break;
+		}
+		if (item.key) {
+			set("key", item.key);
+		}
+		set("value", item.value);
+	}
+	void push(const Luau::AstGenericType& generic) {
+		lua_createtable(thread, 0, 2);
+		set("type", "AstGenericType");
+		set("name", generic.name);
+	}
+	void push(const Luau::AstGenericTypePack& generic) {
+		lua_createtable(thread, 0, 2);
+		set("type", "AstGenericTypePack");
+		set("name", generic.name);
+	}
+	void push(const Luau::AstTableProp& prop) {
+		lua_createtable(thread, 0, 4);
+		set("type", "AstTableProp");
+		set("location", prop.location);
+		set("name", prop.name);
+		set("propType", prop.type);
+	}
+	void push(Luau::AstTableIndexer* indexer) {
+		if (!indexer) {
+			lua_pushnil(thread);
+			return;
+		}
+		lua_createtable(thread, 0, 3);
+		set("location", indexer->location);
+		set("indexType", indexer->indexType);
+		set("resultType", indexer->resultType);
+	}
+	void push(const Luau::AstDeclaredClassProp& prop) {
+		lua_createtable(thread, 0, 3);
+		set("type", "AstDeclaredClassProp");
+		set("name", prop.name);
+		set("luauType", prop.ty);
+	}
+	void push(const Luau::AstArgumentName& name) {
+		lua_createtable(thread, 0, 3);
+		set("type", "AstArgumentName");
+		set("name", name.first);
+		set("location", name.second);
+	}
+	void push(const Luau::AstTypeOrPack& parameter) {
+		if (parameter.type) {
+			push(parameter.type);
+		} else {
+			push(parameter.typePack);
+		}
+	}
+	template <typename T> void push(const std::optional<T>& value) {
+		if (value) {
+			push(*value);
+		} else {
+			lua_pushnil(thread);
+		}
+	}
+	template <typename T> void push(const Luau::AstArray<T>& array) {
+		lua_createtable(thread, static_cast<int>(array.size), 0);
+		for (size_t i = 0; i < array.size; i++) {
+			push(array.data[i]);
+			lua_rawseti(thread, -2, static_cast<int>(i + 1));
+		}
+	}
+	// Expects a table at top of stack
+	template <typename T> void set(const char* field, const T& value) {
+		push(value);
+		lua_setfield(thread, -2, field);
+	}
+
+	void node(Luau::AstNode* node, const char* type) {
+		stack_slots_needed(3);
+		lua_createtable(thread, 0, 6);
+		set("type", type);
+		set("location", node->location);
+	}
+
+	// Kinds this doesn't know still get their location
+	bool visit(Luau::AstNode* node) override {
+		this->node(node, "AstNode");
+		return false;
+	}
+	bool visit(Luau::AstType* node) override {
+		this->node(node, "AstType");
+		return false;
+	}
+	bool visit(Luau::AstTypePack* node) override {
+		this->node(node, "AstTypePack");
+		return false;
+	}
+
+	bool visit(Luau::AstAttr* attribute) override {
+		node(attribute, "AstAttr");
+		switch (attribute->type) {
+		case Luau::AstAttr::Checked: set("name", "checked"); break;
+		case Luau::AstAttr::Native: set("name", "native"); break;
+		default: break;
+		}
+		return false;
+	}
+
+	bool visit(Luau::AstExprGroup* expr) override {
+		node(expr, "AstExprGroup");
+		set("expr", expr->expr);
+		return false;
+	}
+	bool visit(Luau::AstExprConstantNil* expr) override {
+		node(expr, "AstExprConstantNil");
+		return false;
+	}
+	bool visit(Luau::AstExprConstantBool* expr) override {
+		node(expr, "AstExprConstantBool");
+		set("value", expr->value);
+		return false;
+	}
+	bool visit(Luau::AstExprConstantNumber* expr) override {
+		node(expr, "AstExprConstantNumber");
+		set("value", expr->value);
+		return false;
+	}
+	bool visit(Luau::AstExprConstantString* expr) override {
+		node(expr, "AstExprConstantString");
+		set("value", expr->value);
+		return false;
+	}
+	bool visit(Luau::AstExprLocal* expr) override {
+		node(expr, "AstExprLocal");
+		set("local", expr->local);
+		return false;
+	}
+	bool visit(Luau::AstExprGlobal* expr) override {
+		node(expr, "AstExprGlobal");
+		set("global", expr->name);
+		return false;
+	}
+	bool visit(Luau::AstExprVarargs* expr) override {
+		node(expr, "AstExprVarargs");
+		return false;
+	}
+	bool visit(Luau::AstExprCall* expr) override {
+		node(expr, "AstExprCall");
+		set("func", expr->func);
+		set("args", expr->args);
+		set("self", expr->self);
+		set("argLocation", expr->argLocation);
+		return false;
+	}
+	bool visit(Luau::AstExprIndexName* expr) override {
+		node(expr, "AstExprIndexName");
+		set("expr", expr->expr);
+		set("index", expr->index);
+		set("indexLocation", expr->indexLocation);
+		lua_pushlstring(thread, &expr->op, 1);
+		lua_setfield(thread, -2, "op");
+		return false;
+	}
+	bool visit(Luau::AstExprIndexExpr* expr) override {
+		node(expr, "AstExprIndexExpr");
+		set("expr", expr->expr);
+		set("index", expr->index);
+		return false;
+	}
+	bool visit(Luau::AstExprFunction* expr) override {
+		node(expr, "AstExprFunction");
+		set("attributes", expr->attributes);
+		set("generics", expr->generics);
+		set("genericPacks", expr->genericPacks);
+		if (expr->self) {
+			set("self", expr->self);
+		}
+		set("args", expr->args);
+		if (expr->returnAnnotation) {
+			set("returnAnnotation", *expr->returnAnnotation);
+		}
+		set("vararg", expr->vararg);
+		set("varargLocation", expr->varargLocation);
+		if (expr->varargAnnotation) {
+			set("varargAnnotation", expr->varargAnnotation);
+		}
+		set("body", expr->body);
+		set("functionDepth", static_cast<unsigned int>(expr->functionDepth));
+		set("debugname", expr->debugname);
+		return false;
+	}
+	bool visit(Luau::AstExprTable* expr) override {
+		node(expr, "AstExprTable");
+		set("items", expr->items);
+		return false;
+	}
+	bool visit(Luau::AstExprUnary* expr) override {
+		node(expr, "AstExprUnary");
+		switch (expr->op) {
+		case Luau::AstExprUnary::Not: set("op", "Not"); break;
+		case Luau::AstExprUnary::Minus: set("op", "Minus"); break;
+		case Luau::AstExprUnary::Len: set("op", "Len"); break;
+		}
+		set("expr", expr->expr);
+		return false;
+	}
+	bool visit(Luau::AstExprBinary* expr) override {
+		node(expr, "AstExprBinary");
+		set("op", binary_op_name(expr->op));
+		set("left", expr->left);
+		set("right", expr->right);
+		return false;
+	}
+	bool visit(Luau::AstExprTypeAssertion* expr) override {
+		node(expr, "AstExprTypeAssertion");
+		set("expr", expr->expr);
+		set("annotation", expr->annotation);
+		return false;
+	}
+	bool visit(Luau::AstExprIfElse* expr) override {
+		node(expr, "AstExprIfElse");
+		set("condition", expr->condition);
+		set("hasThen", expr->hasThen);
+		set("trueExpr", expr->trueExpr);
+		set("hasElse", expr->hasElse);
+		set("falseExpr", expr->falseExpr);
+		return false;
+	}
+	bool visit(Luau::AstExprInterpString* expr) override {
+		node(expr, "AstExprInterpString");
+		set("strings", expr->strings);
+		set("expressions", expr->expressions);
+		return false;
+	}
+	bool visit(Luau::AstExprError* expr) override {
+		node(expr, "AstExprError");
+		set("expressions", expr->expressions);
+		set("messageIndex", expr->messageIndex);
+		return false;
+	}
+
+	bool visit(Luau::AstStatBlock* stat) override {
+		node(stat, "AstStatBlock");
+		set("hasEnd", stat->hasEnd);
+		set("body", stat->body);
+		return false;
+	}
+	bool visit(Luau::AstStatIf* stat) override {
+		node(stat, "AstStatIf");
+		set("condition", stat->condition);
+		set("thenbody", stat->thenbody);
+		if (stat->elsebody) {
+			set("elsebody", stat->elsebody);
+		}
+		set("thenLocation", stat->thenLocation);
+		set("elseLocation", stat->elseLocation);
+		return false;
+	}
+	bool visit(Luau::AstStatWhile* stat) override {
+		node(stat, "AstStatWhile");
+		set("condition", stat->condition);
+		set("body", stat->body);
+		set("hasDo", stat->hasDo);
+		return false;
+	}
+	bool visit(Luau::AstStatRepeat* stat) override {
+		node(stat, "AstStatRepeat");
+		set("condition", stat->condition);
+		set("body", stat->body);
+		return false;
+	}
+	bool visit(Luau::AstStatBreak* stat) override {
+		node(stat, "AstStatBreak");
+		return false;
+	}
+	bool visit(Luau::AstStatContinue* stat) override {
+		node(stat, "AstStatContinue");
+		return false;
+	}
+	bool visit(Luau::AstStatReturn* stat) override {
+		node(stat, "AstStatReturn");
+		set("list", stat->list);
+		return false;
+	}
+	bool visit(Luau::AstStatExpr* stat) override {
+		node(stat, "AstStatExpr");
+		set("expr", stat->expr);
+		return false;
+	}
+	bool visit(Luau::AstStatLocal* stat) override {
+		node(stat, "AstStatLocal");
+		set("vars", stat->vars);
+		set("values", stat->values);
+		return false;
+	}
+	bool visit(Luau::AstStatFor* stat) override {
+		node(stat, "AstStatFor");
+		set("var", stat->var);
+		set("from", stat->from);
+		set("to", stat->to);
+		if (stat->step) {
+			set("step", stat->step);
+		}
+		set("body", stat->body);
+		set("hasDo", stat->hasDo);
+		return false;
+	}
+	bool visit(Luau::AstStatForIn* stat) override {
+		node(stat, "AstStatForIn");
+		set("vars", stat->vars);
+		set("values", stat->values);
+		set("body", stat->body);
+		set("hasIn", stat->hasIn);
+		set("hasDo", stat->hasDo);
+		return false;
+	}
+	bool visit(Luau::AstStatAssign* stat) override {
+		node(stat, "AstStatAssign");
+		set("vars", stat->vars);
+		set("values", stat->values);
+		return false;
+	}
+	bool visit(Luau::AstStatCompoundAssign* stat) override {
+		node(stat, "AstStatCompoundAssign");
+		set("op", binary_op_name(stat->op));
+		set("var", stat->var);
+		set("value", stat->value);
+		return false;
+	}
+	bool visit(Luau::AstStatFunction* stat) override {
+		node(stat, "AstStatFunction");
+		set("name", stat->name);
+		set("func", stat->func);
+		return false;
+	}
+	bool visit(Luau::AstStatLocalFunction* stat) override {
+		node(stat, "AstStatLocalFunction");
+		set("name", stat->name);
+		set("func", stat->func);
+		return false;
+	}
+	bool visit(Luau::AstStatTypeAlias* stat) override {
+		node(stat, "AstStatTypeAlias");
+		set("name", stat->name);
+		set("generics", stat->generics);
+		set("genericPacks", stat->genericPacks);
+		set("value", stat->type);
+		set("exported", stat->exported);
+		return false;
+	}
+	bool visit(Luau::AstStatTypeFunction* stat) override {
+		node(stat, "AstStatTypeFunction");
+		set("name", stat->name);
+		set("body", stat->body);
+		set("exported", stat->exported);
+		return false;
+	}
+	bool visit(Luau::AstStatDeclareFunction* stat) override {
+		node(stat, "AstStatDeclareFunction");
+		set("name", stat->name);
+		set("nameLocation", stat->nameLocation);
+		set("params", stat->params);
+		set("paramNames", stat->paramNames);
+		set("vararg", stat->vararg);
+		set("varargLocation", stat->varargLocation);
+		set("retTypes", stat->retTypes);
+		set("generics", stat->generics);
+		set("genericPacks", stat->genericPacks);
+		return false;
+	}
+	bool visit(Luau::AstStatDeclareGlobal* stat) override {
+		node(stat, "AstStatDeclareGlobal");
+		set("name", stat->name);
+		set("nameLocation", stat->nameLocation);
+		set("type", stat->type);
+		return false;
+	}
+	bool visit(Luau::AstStatDeclareClass* stat) override {
+		node(stat, "AstStatDeclareClass");
+		set("name", stat->name);
+		if (stat->superName) {
+			set("superName", *stat->superName);
+		}
+		set("props", stat->props);
+		set("indexer", stat->indexer);
+		return false;
+	}
+	bool visit(Luau::AstStatError* stat) override {
+		node(stat, "AstStatError");
+		set("expressions", stat->expressions);
+		set("statements", stat->statements);
+		return false;
+	}
+
+	bool visit(Luau::AstTypeReference* type) override {
+		node(type, "AstTypeReference");
+		if (type->prefix) {
+			set("prefix", *type->prefix);
+		}
+		if (type->prefixLocation) {
+			set("prefixLocation", *type->prefixLocation);
+		}
+		set("name", type->name);
+		set("nameLocation", type->nameLocation);
+		set("parameters", type->parameters);
+		return false;
+	}
+	bool visit(Luau::AstTypeTable* type) override {
+		node(type, "AstTypeTable");
+		set("props", type->props);
+		set("indexer", type->indexer);
+		return false;
+	}
+	bool visit(Luau::AstTypeFunction* type) override {
+		node(type, "AstTypeFunction");
+		set("generics", type->generics);
+		set("genericPacks", type->genericPacks);
+		set("argTypes", type->argTypes);
+		set("argNames", type->argNames);
+		set("returnTypes", type->returnTypes);
+		return false;
+	}
+	bool visit(Luau::AstTypeTypeof* type) override {
+		node(type, "AstTypeTypeof");
+		set("expr", type->expr);
+		return false;
+	}
+	bool visit(Luau::AstTypeUnion* type) override {
+		node(type, "AstTypeUnion");
+		set("types", type->types);
+		return false;
+	}
+	bool visit(Luau::AstTypeIntersection* type) override {
+		node(type, "AstTypeIntersection");
+		set("types", type->types);
+		return false;
+	}
+	bool visit(Luau::AstTypeSingletonBool* type) override {
+		node(type, "AstTypeSingletonBool");
+		set("value", type->value);
+		return false;
+	}
+	bool visit(Luau::AstTypeSingletonString* type) override {
+		node(type, "AstTypeSingletonString");
+		set("value", type->value);
+		return false;
+	}
+	bool visit(Luau::AstTypeError* type) override {
+		node(type, "AstTypeError");
+		set("types", type->types);
+		set("messageIndex", type->messageIndex);
+		return false;
+	}
+	bool visit(Luau::AstTypePackExplicit* pack) override {
+		node(pack, "AstTypePackExplicit");
+		set("typeList", pack->typeList);
+		return false;
+	}
+	bool visit(Luau::AstTypePackVariadic* pack) override {
+		node(pack, "AstTypePackVariadic");
+		set("variadicType", pack->variadicType);
+		return false;
+	}
+	bool visit(Luau::AstTypePackGeneric* pack) override {
+		node(pack, "AstTypePackGeneric");
+		set("genericName", pack->genericName);
+		return false;
+	}
+
+	static const char* binary_op_name(Luau::AstExprBinary::Op op) {
+		using Op = Luau::AstExprBinary::Op;
+		switch (op) {
+		case Op::Add: return "Add";
+		case Op::Sub: return "Sub";
+		case Op::Mul: return "Mul";
+		case Op::Div: return "Div";
+		case Op::FloorDiv: return "FloorDiv";
+		case Op::Mod: return "Mod";
+		case Op::Pow: return "Pow";
+		case Op::Concat: return "Concat";
+		case Op::CompareNe: return "CompareNe";
+		case Op::CompareEq: return "CompareEq";
+		case Op::CompareLt: return "CompareLt";
+		case Op::CompareLe: return "CompareLe";
+		case Op::CompareGt: return "CompareGt";
+		case Op::CompareGe: return "CompareGe";
+		case Op::And: return "And";
+		case Op::Or: return "Or";
+		default: return "Unknown";
+		}
+	}
+};
+
+void push_ast(lua_State* thread, Luau::AstNode* node, const std::vector<Luau::Comment>& comments, const ast_location_map* map) {
+	stack_slots_needed(3);
+	ast_pusher pusher(thread, map);
+	lua_createtable(thread, 0, 2);
+	pusher.set("root", node);
+	lua_createtable(thread, static_cast<int>(comments.size()), 0);
+	for (size_t i = 0; i < comments.size(); i++) {
+		lua_createtable(thread, 0, 2);
+		switch (comments[i].type) {
+		case Luau::Lexeme::Comment: pusher.set("type", "Comment"); break;
+		case Luau::Lexeme::BlockComment: pusher.set("type", "BlockComment"); break;
+		default: pusher.set("type", "BrokenComment"); break;
+		}
+		pusher.set("location", comments[i].location);
+		lua_rawseti(thread, -2, static_cast<int>(i + 1));
+	}
+	lua_setfield(thread, -2, "commentLocations");
+}
+
+// This is what ChatGPT is good for
+std::string replace_outside_quotes(
+	const std::string& input_str,
+	const std::string& search_str,
+	const std::string& replace_str
+) {
+	std::string result;
+	result.reserve(input_str.size());
+
+	bool in_quotes = false;
+	int backslash_count = 0;
+	size_t i = 0;
+
+	while (i < input_str.size()) {
+		char c = input_str[i];
+
+		if (in_quotes) {
+			result.push_back(c);
+
+			if (c == '\\') {
+				backslash_count++;
+			} else {
+				if (c == '"' && (backslash_count % 2 == 0)) {
+					in_quotes = false;
+				}
+				backslash_count = 0;
+			}
+			++i;
+		} else {
+			if (c == '"') {
+				in_quotes = true;
+				result.push_back(c);
+				++i;
+				backslash_count = 0;
+			} else {
+				if (!search_str.empty()
+					&& i + search_str.size() <= input_str.size()
+					&& input_str.compare(i, search_str.size(), search_str) == 0) {
+					result += replace_str;
+					i += search_str.size();
+				} else {
+					result.push_back(c);
+					++i;
+				}
+			}
+		}
+	}
+
+	return result;
+}
+
+std::string ast_to_json(Luau::AstNode* node, const std::vector<Luau::Comment>& comments) {
+	std::string ast_json = Luau::toJson(node, comments);
+	ast_json = replace_outside_quotes(ast_json, "-Infinity", "\"-Infinity\"");
+	ast_json = replace_outside_quotes(ast_json, "Infinity", "\"Infinity\"");
+	ast_json = replace_outside_quotes(ast_json, "NaN", "\"NaN\"");
+	return ast_json;
+}
\ No newline at end of file
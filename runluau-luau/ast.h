@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "luau.h"
+
+#include <Luau/Ast.h>
+#include <Luau/Location.h>
+#include <Luau/ParseResult.h>
+
+// Moves locations from the source a node was parsed from to where they are in an edited source.
+// Positions on `first_line` also move by `columns`, and exact `replacements` are swapped out instead.
+struct ast_location_map {
+	unsigned int first_line = 0;
+	int lines = 0;
+	int columns = 0;
+	std::vector<std::pair<Luau::Location, Luau::Location>> replacements;
+
+	Luau::Location apply(Luau::Location location) const;
+};
+
+// Luau::toJson, with the non-standard numbers it writes turned into strings
+std::string ast_to_json(Luau::AstNode* node, const std::vector<Luau::Comment>& comments);
+// Pushes the AST as tables in the shape `ast_to_json` writes, `{root, commentLocations}`, but with locations as
+// `{begin_line, begin_column, end_line, end_column}`
+void push_ast(lua_State* thread, Luau::AstNode* node, const std::vector<Luau::Comment>& comments, const ast_location_map* map = nullptr);
\ No newline at end of file
@@ -0,0 +1,863 @@
+#include "pch.h"
+
+#include "bytecode.h"
+#include "util.h"
+
+// Reader for the serialized bytecode format, following the same layout luau_load expects
+struct bytecode_reader {
+	std::string_view data;
+	size_t offset = 0;
+	bool failed = false;
+
+	bool has(size_t size) {
+		if (failed || data.size() - offset < size) {
+			failed = true;
+			return false;
+		}
+		return true;
+	}
+	template <typename T> T read() {
+		T value{};
+		if (has(sizeof(T))) {
+			memcpy(&value, data.data() + offset, sizeof(T));
+			offset += sizeof(T);
+		}
+		return value;
+	}
+	uint32_t read_varint() {
+		uint32_t result = 0;
+		uint32_t shift = 0;
+		uint8_t byte;
+		do {
+			byte = read<uint8_t>();
+			result |= static_cast<uint32_t>(byte & 127) << shift;
+			shift += 7;
+		} while ((byte & 128) && !failed && shift < 35);
+		return result;
+	}
+	std::string_view read_bytes(size_t size) {
+		if (!has(size)) {
+			return {};
+		}
+		std::string_view bytes = data.substr(offset, size);
+		offset += size;
+		return bytes;
+	}
+	// Sizes come from untrusted input, so they're checked against what's left before reserving memory
+	uint32_t read_count(size_t minimum_element_size) {
+		uint32_t count = read_varint();
+		if (minimum_element_size && count > (data.size() - offset) / minimum_element_size) {
+			failed = true;
+			return 0;
+		}
+		return count;
+	}
+};
+
+bool read_constant(bytecode_reader& reader, bytecode_constant& constant) {
+	constant.type = reader.read<uint8_t>();
+	switch (constant.type) {
+	case LBC_CONSTANT_NIL:
+		break;
+	case LBC_CONSTANT_BOOLEAN:
+		constant.boolean = reader.read<uint8_t>() != 0;
+		break;
+	case LBC_CONSTANT_NUMBER:
+		constant.number = reader.read<double>();
+		break;
+	case LBC_CONSTANT_VECTOR:
+		for (float& component : constant.vector) {
+			component = reader.read<float>();
+		}
+		break;
+	case LBC_CONSTANT_STRING:
+		constant.index = reader.read_varint();
+		break;
+	case LBC_CONSTANT_IMPORT:
+		constant.index = reader.read<uint32_t>();
+		break;
+	case LBC_CONSTANT_TABLE: {
+		uint32_t count = reader.read_count(1);
+		constant.keys.resize(count);
+		for (uint32_t& key : constant.keys) {
+			key = reader.read_varint();
+		}
+		break;
+	}
+	case LBC_CONSTANT_CLOSURE:
+		constant.index = reader.read_varint();
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+bool read_function(bytecode_reader& reader, const bytecode_module& module, bytecode_function& function) {
+	function.max_stack_size = reader.read<uint8_t>();
+	function.num_params = reader.read<uint8_t>();
+	function.num_upvalues = reader.read<uint8_t>();
+	function.is_vararg = reader.read<uint8_t>();
+	if (module.version >= 4) {
+		function.flags = reader.read<uint8_t>();
+		uint32_t type_size = reader.read_count(1);
+		function.type_info = reader.read_bytes(type_size);
+	}
+
+	uint32_t code_size = reader.read_count(sizeof(uint32_t));
+	function.code.resize(code_size);
+	for (uint32_t& instruction : function.code) {
+		instruction = reader.read<uint32_t>();
+	}
+
+	uint32_t constant_count = reader.read_count(1);
+	function.constants.resize(constant_count);
+	for (bytecode_constant& constant : function.constants) {
+		if (!read_constant(reader, constant)) {
+			return false;
+		}
+	}
+
+	uint32_t child_count = reader.read_count(1);
+	function.children.resize(child_count);
+	for (uint32_t& child : function.children) {
+		child = reader.read_varint();
+	}
+
+	function.line_defined = reader.read_varint();
+	function.debug_name = reader.read_varint();
+
+	function.has_line_info = reader.read<uint8_t>() != 0;
+	if (function.has_line_info) {
+		function.line_gap_log2 = reader.read<uint8_t>();
+		if (function.line_gap_log2 >= 32) {
+			return false;
+		}
+		size_t intervals = code_size ? ((code_size - 1) >> function.line_gap_log2) + 1 : 0;
+		std::string_view deltas = reader.read_bytes(code_size);
+		function.line_deltas.assign(deltas.begin(), deltas.end());
+		if (!reader.has(intervals * sizeof(int32_t))) {
+			return false;
+		}
+		function.abs_line_deltas.resize(intervals);
+		for (int32_t& delta : function.abs_line_deltas) {
+			delta = reader.read<int32_t>();
+		}
+	}
+
+	function.has_debug_info = reader.read<uint8_t>() != 0;
+	if (function.has_debug_info) {
+		uint32_t local_count = reader.read_count(4);
+		function.locals.resize(local_count);
+		for (bytecode_local& local : function.locals) {
+			local.name = reader.read_varint();
+			local.start_pc = reader.read_varint();
+			local.end_pc = reader.read_varint();
+			local.reg = reader.read<uint8_t>();
+		}
+		uint32_t upvalue_count = reader.read_count(1);
+		function.upvalue_names.resize(upvalue_count);
+		for (uint32_t& name : function.upvalue_names) {
+			name = reader.read_varint();
+		}
+	}
+	return !reader.failed;
+}
+
+// Every reference between sections is checked up front so nothing downstream has to
+bool validate_function(const bytecode_module& module, const bytecode_function& function) {
+	size_t string_count = module.strings.size();
+	auto valid_string = [&](uint32_t reference) {
+		return reference <= string_count;
+	};
+	if (!valid_string(function.debug_name)) {
+		return false;
+	}
+	for (const bytecode_constant& constant : function.constants) {
+		if (constant.type == LBC_CONSTANT_STRING && (constant.index == 0 || !valid_string(constant.index))) {
+			return false;
+		}
+		if (constant.type == LBC_CONSTANT_CLOSURE && constant.index >= module.functions.size()) {
+			return false;
+		}
+		for (uint32_t key : constant.keys) {
+			if (key >= function.constants.size()) {
+				return false;
+			}
+		}
+	}
+	for (uint32_t child : function.children) {
+		if (child >= module.functions.size()) {
+			return false;
+		}
+	}
+	for (const bytecode_local& local : function.locals) {
+		if (!valid_string(local.name)) {
+			return false;
+		}
+	}
+	for (uint32_t name : function.upvalue_names) {
+		if (!valid_string(name)) {
+			return false;
+		}
+	}
+	for (size_t pc = 0; pc < function.code.size(); pc += opcode_length(LUAU_INSN_OP(function.code[pc]))) {
+		uint8_t op = LUAU_INSN_OP(function.code[pc]);
+		if (op >= LOP__COUNT) {
+			return false;
+		}
+		// Every pass over the code reads the AUX word unchecked, so it has to be inside the function
+		if (pc + opcode_length(op) > function.code.size()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool read_bytecode(std::string_view data, bytecode_module& module, std::string& error) {
+	bytecode_reader reader{.data = data};
+	module.version = reader.read<uint8_t>();
+	if (reader.failed) {
+		error = "bytecode is empty";
+		return false;
+	}
+	if (module.version == 0) {
+		// Compile errors are encoded as a zero version followed by the message
+		error = data.substr(1);
+		return false;
+	}
+	if (module.version < LBC_VERSION_MIN || module.version > LBC_VERSION_MAX) {
+		error = "unsupported bytecode version " + std::to_string(module.version);
+		return false;
+	}
+	if (module.version >= 4) {
+		module.types_version = reader.read<uint8_t>();
+	}
+
+	uint32_t string_count = reader.read_count(1);
+	module.strings.resize(string_count);
+	for (std::string& string : module.strings) {
+		uint32_t length = reader.read_varint();
+		string = reader.read_bytes(length);
+	}
+
+	if (module.types_version == 3) {
+		for (uint8_t index = reader.read<uint8_t>(); index != 0 && !reader.failed; index = reader.read<uint8_t>()) {
+			module.userdata_types.emplace_back(index, reader.read_varint());
+		}
+	}
+
+	uint32_t function_count = reader.read_count(7);
+	module.functions.resize(function_count);
+	for (bytecode_function& function : module.functions) {
+		if (!read_function(reader, module, function)) {
+			error = "malformed function in bytecode";
+			return false;
+		}
+	}
+	module.main = reader.read_varint();
+
+	if (reader.failed) {
+		error = "bytecode is truncated";
+		return false;
+	}
+	if (module.main >= module.functions.size()) {
+		error = "bytecode has no main function";
+		return false;
+	}
+	for (const bytecode_function& function : module.functions) {
+		if (!validate_function(module, function)) {
+			error = "malformed function in bytecode";
+			return false;
+		}
+	}
+	return true;
+}
+
+// Writer for the same layout, the inverse of bytecode_reader
+struct bytecode_writer {
+	std::string data;
+
+	template <typename T> void write(T value) {
+		data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+	void write_varint(uint32_t value) {
+		do {
+			uint8_t byte = value & 127;
+			value >>= 7;
+			write<uint8_t>(value ? byte | 128 : byte);
+		} while (value);
+	}
+	void write_bytes(std::string_view bytes) {
+		data.append(bytes);
+	}
+};
+
+void write_constant(bytecode_writer& writer, const bytecode_constant& constant) {
+	writer.write<uint8_t>(constant.type);
+	switch (constant.type) {
+	case LBC_CONSTANT_BOOLEAN:
+		writer.write<uint8_t>(constant.boolean);
+		break;
+	case LBC_CONSTANT_NUMBER:
+		writer.write<double>(constant.number);
+		break;
+	case LBC_CONSTANT_VECTOR:
+		for (float component : constant.vector) {
+			writer.write<float>(component);
+		}
+		break;
+	case LBC_CONSTANT_STRING:
+	case LBC_CONSTANT_CLOSURE:
+		writer.write_varint(constant.index);
+		break;
+	case LBC_CONSTANT_IMPORT:
+		writer.write<uint32_t>(constant.index);
+		break;
+	case LBC_CONSTANT_TABLE:
+		writer.write_varint(static_cast<uint32_t>(constant.keys.size()));
+		for (uint32_t key : constant.keys) {
+			writer.write_varint(key);
+		}
+		break;
+	}
+}
+
+void write_function(bytecode_writer& writer, const bytecode_module& module, const bytecode_function& function) {
+	writer.write<uint8_t>(function.max_stack_size);
+	writer.write<uint8_t>(function.num_params);
+	writer.write<uint8_t>(function.num_upvalues);
+	writer.write<uint8_t>(function.is_vararg);
+	if (module.version >= 4) {
+		writer.write<uint8_t>(function.flags);
+		writer.write_varint(static_cast<uint32_t>(function.type_info.size()));
+		writer.write_bytes(function.type_info);
+	}
+
+	writer.write_varint(static_cast<uint32_t>(function.code.size()));
+	for (uint32_t instruction : function.code) {
+		writer.write<uint32_t>(instruction);
+	}
+	writer.write_varint(static_cast<uint32_t>(function.constants.size()));
+	for (const bytecode_constant& constant : function.constants) {
+		write_constant(writer, constant);
+	}
+	writer.write_varint(static_cast<uint32_t>(function.children.size()));
+	for (uint32_t child : function.children) {
+		writer.write_varint(child);
+	}
+
+	writer.write_varint(function.line_defined);
+	writer.write_varint(function.debug_name);
+
+	writer.write<uint8_t>(function.has_line_info);
+	if (function.has_line_info) {
+		writer.write<uint8_t>(function.line_gap_log2);
+		writer.write_bytes(std::string_view(reinterpret_cast<const char*>(function.line_deltas.data()), function.line_deltas.size()));
+		for (int32_t delta : function.abs_line_deltas) {
+			writer.write<int32_t>(delta);
+		}
+	}
+
+	writer.write<uint8_t>(function.has_debug_info);
+	if (function.has_debug_info) {
+		writer.write_varint(static_cast<uint32_t>(function.locals.size()));
+		for (const bytecode_local& local : function.locals) {
+			writer.write_varint(local.name);
+			writer.write_varint(local.start_pc);
+			writer.write_varint(local.end_pc);
+			writer.write<uint8_t>(local.reg);
+		}
+		writer.write_varint(static_cast<uint32_t>(function.upvalue_names.size()));
+		for (uint32_t name : function.upvalue_names) {
+			writer.write_varint(name);
+		}
+	}
+}
+
+std::string write_bytecode(const bytecode_module& module) {
+	bytecode_writer writer;
+	writer.write<uint8_t>(module.version);
+	if (module.version >= 4) {
+		writer.write<uint8_t>(module.types_version);
+	}
+	writer.write_varint(static_cast<uint32_t>(module.strings.size()));
+	for (const std::string& string : module.strings) {
+		writer.write_varint(static_cast<uint32_t>(string.size()));
+		writer.write_bytes(string);
+	}
+	if (module.types_version == 3) {
+		for (const auto& [index, name] : module.userdata_types) {
+			writer.write<uint8_t>(index);
+			writer.write_varint(name);
+		}
+		writer.write<uint8_t>(0);
+	}
+	writer.write_varint(static_cast<uint32_t>(module.functions.size()));
+	for (const bytecode_function& function : module.functions) {
+		write_function(writer, module, function);
+	}
+	writer.write_varint(module.main);
+	return std::move(writer.data);
+}
+
+std::vector<int> bytecode_function::lines() const {
+	std::vector<int> result;
+	if (!has_line_info) {
+		return result;
+	}
+	result.resize(code.size());
+	uint8_t offset = 0;
+	for (size_t pc = 0; pc < code.size(); pc++) {
+		offset += line_deltas[pc];
+		result[pc] = offset;
+	}
+	int line = 0;
+	for (size_t interval = 0; interval < abs_line_deltas.size(); interval++) {
+		line += abs_line_deltas[interval];
+		size_t begin = interval << line_gap_log2;
+		size_t end = (interval + 1) << line_gap_log2;
+		for (size_t pc = begin; pc < end && pc < code.size(); pc++) {
+			result[pc] += line;
+		}
+	}
+	return result;
+}
+
+const char* opcode_name(uint8_t op) {
+#define OPCODE(name) case LOP_##name: return #name;
+	switch (op) {
+	OPCODE(NOP) OPCODE(BREAK) OPCODE(LOADNIL) OPCODE(LOADB) OPCODE(LOADN) OPCODE(LOADK) OPCODE(MOVE)
+	OPCODE(GETGLOBAL) OPCODE(SETGLOBAL) OPCODE(GETUPVAL) OPCODE(SETUPVAL) OPCODE(CLOSEUPVALS) OPCODE(GETIMPORT)
+	OPCODE(GETTABLE) OPCODE(SETTABLE) OPCODE(GETTABLEKS) OPCODE(SETTABLEKS) OPCODE(GETTABLEN) OPCODE(SETTABLEN)
+	OPCODE(NEWCLOSURE) OPCODE(NAMECALL) OPCODE(CALL) OPCODE(RETURN) OPCODE(JUMP) OPCODE(JUMPBACK)
+	OPCODE(JUMPIF) OPCODE(JUMPIFNOT) OPCODE(JUMPIFEQ) OPCODE(JUMPIFLE) OPCODE(JUMPIFLT)
+	OPCODE(JUMPIFNOTEQ) OPCODE(JUMPIFNOTLE) OPCODE(JUMPIFNOTLT)
+	OPCODE(ADD) OPCODE(SUB) OPCODE(MUL) OPCODE(DIV) OPCODE(MOD) OPCODE(POW) OPCODE(IDIV)
+	OPCODE(ADDK) OPCODE(SUBK) OPCODE(MULK) OPCODE(DIVK) OPCODE(MODK) OPCODE(POWK) OPCODE(IDIVK) OPCODE(SUBRK) OPCODE(DIVRK)
+	OPCODE(AND) OPCODE(OR) OPCODE(ANDK) OPCODE(ORK) OPCODE(CONCAT) OPCODE(NOT) OPCODE(MINUS) OPCODE(LENGTH)
+	OPCODE(NEWTABLE) OPCODE(DUPTABLE) OPCODE(SETLIST) OPCODE(FORNPREP) OPCODE(FORNLOOP) OPCODE(FORGLOOP)
+	OPCODE(FORGPREP_INEXT) OPCODE(FORGPREP_NEXT) OPCODE(FORGPREP) OPCODE(NATIVECALL) OPCODE(GETVARARGS)
+	OPCODE(DUPCLOSURE) OPCODE(PREPVARARGS) OPCODE(LOADKX) OPCODE(JUMPX) OPCODE(COVERAGE) OPCODE(CAPTURE)
+	OPCODE(FASTCALL) OPCODE(FASTCALL1) OPCODE(FASTCALL2) OPCODE(FASTCALL2K) OPCODE(FASTCALL3)
+	OPCODE(JUMPXEQKNIL) OPCODE(JUMPXEQKB) OPCODE(JUMPXEQKN) OPCODE(JUMPXEQKS)
+	default: return "UNKNOWN";
+	}
+#undef OPCODE
+}
+int opcode_length(uint8_t op) {
+	return op < LOP__COUNT ? Luau::getOpLength(static_cast<LuauOpcode>(op)) : 1;
+}
+
+bool is_fastcall(uint8_t op) {
+	return op == LOP_FASTCALL || op == LOP_FASTCALL1 || op == LOP_FASTCALL2 || op == LOP_FASTCALL2K || op == LOP_FASTCALL3;
+}
+// Absolute pc an instruction can branch to, or -1
+int branch_target(uint32_t instruction, size_t pc) {
+	switch (LUAU_INSN_OP(instruction)) {
+	case LOP_JUMP: case LOP_JUMPBACK: case LOP_JUMPIF: case LOP_JUMPIFNOT:
+	case LOP_JUMPIFEQ: case LOP_JUMPIFLE: case LOP_JUMPIFLT: case LOP_JUMPIFNOTEQ: case LOP_JUMPIFNOTLE: case LOP_JUMPIFNOTLT:
+	case LOP_FORNPREP: case LOP_FORNLOOP: case LOP_FORGLOOP: case LOP_FORGPREP_INEXT: case LOP_FORGPREP_NEXT: case LOP_FORGPREP:
+	case LOP_JUMPXEQKNIL: case LOP_JUMPXEQKB: case LOP_JUMPXEQKN: case LOP_JUMPXEQKS:
+		return static_cast<int>(pc) + 1 + LUAU_INSN_D(instruction);
+	case LOP_JUMPX:
+		return static_cast<int>(pc) + 1 + LUAU_INSN_E(instruction);
+	case LOP_LOADB:
+		return LUAU_INSN_C(instruction) ? static_cast<int>(pc) + 1 + LUAU_INSN_C(instruction) : -1;
+	default:
+		return is_fastcall(LUAU_INSN_OP(instruction)) ? static_cast<int>(pc) + 1 + LUAU_INSN_C(instruction) : -1;
+	}
+}
+
+// Imports pack up to three constant indices of the path's names after a 2 bit count
+std::string import_path(const bytecode_module& module, const bytecode_function& function, uint32_t id) {
+	std::string path;
+	uint32_t count = id >> 30;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t index = (id >> (20 - i * 10)) & 1023;
+		if (i) {
+			path += '.';
+		}
+		if (index < function.constants.size() && function.constants[index].type == LBC_CONSTANT_STRING) {
+			path += module.string(function.constants[index].index);
+		} else {
+			path += '?';
+		}
+	}
+	return path;
+}
+
+// `set` functions expect a table at top of stack
+inline void set_bytecode_number(lua_State* thread, double value, const char* field) {
+	lua_pushnumber(thread, value);
+	lua_setfield(thread, -2, field);
+}
+inline void set_bytecode_string(lua_State* thread, const char* value, const char* field) {
+	if (value) {
+		lua_pushstring(thread, value);
+		lua_setfield(thread, -2, field);
+	}
+}
+
+void push_constant(lua_State* thread, const bytecode_module& module, const bytecode_function& function, const bytecode_constant& constant) {
+	stack_slots_needed(3);
+	lua_createtable(thread, 0, 2);
+	switch (constant.type) {
+	case LBC_CONSTANT_NIL:
+		set_bytecode_string(thread, "nil", "type");
+		break;
+	case LBC_CONSTANT_BOOLEAN:
+		set_bytecode_string(thread, "boolean", "type");
+		lua_pushboolean(thread, constant.boolean);
+		lua_setfield(thread, -2, "value");
+		break;
+	case LBC_CONSTANT_NUMBER:
+		set_bytecode_string(thread, "number", "type");
+		set_bytecode_number(thread, constant.number, "value");
+		break;
+	case LBC_CONSTANT_VECTOR:
+		set_bytecode_string(thread, "vector", "type");
+		lua_createtable(thread, 4, 0);
+		for (int i = 0; i < 4; i++) {
+			lua_pushnumber(thread, constant.vector[i]);
+			lua_rawseti(thread, -2, i + 1);
+		}
+		lua_setfield(thread, -2, "value");
+		break;
+	case LBC_CONSTANT_STRING: {
+		set_bytecode_string(thread, "string", "type");
+		const std::string& string = module.strings[constant.index - 1];
+		lua_pushlstring(thread, string.data(), string.size());
+		lua_setfield(thread, -2, "value");
+		break;
+	}
+	case LBC_CONSTANT_IMPORT:
+		set_bytecode_string(thread, "import", "type");
+		set_bytecode_string(thread, import_path(module, function, constant.index).c_str(), "value");
+		break;
+	case LBC_CONSTANT_TABLE:
+		set_bytecode_string(thread, "table", "type");
+		lua_createtable(thread, static_cast<int>(constant.keys.size()), 0);
+		for (size_t i = 0; i < constant.keys.size(); i++) {
+			lua_pushunsigned(thread, constant.keys[i]);
+			lua_rawseti(thread, -2, static_cast<int>(i + 1));
+		}
+		lua_setfield(thread, -2, "keys");
+		break;
+	case LBC_CONSTANT_CLOSURE:
+		set_bytecode_string(thread, "closure", "type");
+		set_bytecode_number(thread, constant.index, "function");
+		break;
+	}
+}
+
+void push_instruction(lua_State* thread, const bytecode_function& function, size_t pc, int line) {
+	stack_slots_needed(2);
+	uint32_t instruction = function.code[pc];
+	uint8_t op = LUAU_INSN_OP(instruction);
+	lua_createtable(thread, 0, 10);
+	set_bytecode_number(thread, static_cast<double>(pc), "pc");
+	set_bytecode_string(thread, opcode_name(op), "op");
+	set_bytecode_number(thread, LUAU_INSN_A(instruction), "a");
+	set_bytecode_number(thread, LUAU_INSN_B(instruction), "b");
+	set_bytecode_number(thread, LUAU_INSN_C(instruction), "c");
+	set_bytecode_number(thread, LUAU_INSN_D(instruction), "d");
+	set_bytecode_number(thread, LUAU_INSN_E(instruction), "e");
+	if (opcode_length(op) == 2 && pc + 1 < function.code.size()) {
+		set_bytecode_number(thread, function.code[pc + 1], "aux");
+	}
+	if (line >= 0) {
+		set_bytecode_number(thread, line, "line");
+	}
+	int target = branch_target(instruction, pc);
+	if (is_fastcall(op)) {
+		// The builtin runs instead of the CALL at `target` when its arguments are what it expects
+		set_bytecode_number(thread, LUAU_INSN_A(instruction), "builtin");
+		set_bytecode_number(thread, target, "call_pc");
+	} else if (target >= 0) {
+		set_bytecode_number(thread, target, "target");
+	}
+}
+
+void push_function(lua_State* thread, const bytecode_module& module, size_t id) {
+	stack_slots_needed(4);
+	const bytecode_function& function = module.functions[id];
+	lua_createtable(thread, 0, 16);
+	set_bytecode_number(thread, static_cast<double>(id), "id");
+	set_bytecode_string(thread, module.string(function.debug_name), "name");
+	set_bytecode_number(thread, function.line_defined, "line_defined");
+	set_bytecode_number(thread, function.max_stack_size, "max_stack_size");
+	set_bytecode_number(thread, function.num_params, "num_params");
+	set_bytecode_number(thread, function.num_upvalues, "num_upvalues");
+	lua_pushboolean(thread, function.is_vararg);
+	lua_setfield(thread, -2, "is_vararg");
+	set_bytecode_number(thread, function.flags, "flags");
+
+	lua_createtable(thread, static_cast<int>(function.constants.size()), 0);
+	for (size_t i = 0; i < function.constants.size(); i++) {
+		push_constant(thread, module, function, function.constants[i]);
+		lua_rawseti(thread, -2, static_cast<int>(i + 1));
+	}
+	lua_setfield(thread, -2, "constants");
+
+	lua_createtable(thread, static_cast<int>(function.children.size()), 0);
+	for (size_t i = 0; i < function.children.size(); i++) {
+		lua_pushunsigned(thread, function.children[i]);
+		lua_rawseti(thread, -2, static_cast<int>(i + 1));
+	}
+	lua_setfield(thread, -2, "children");
+
+	if (function.has_debug_info) {
+		lua_createtable(thread, static_cast<int>(function.locals.size()), 0);
+		for (size_t i = 0; i < function.locals.size(); i++) {
+			const bytecode_local& local = function.locals[i];
+			lua_createtable(thread, 0, 4);
+			set_bytecode_string(thread, module.string(local.name), "name");
+			set_bytecode_number(thread, local.start_pc, "start_pc");
+			set_bytecode_number(thread, local.end_pc, "end_pc");
+			set_bytecode_number(thread, local.reg, "register");
+			lua_rawseti(thread, -2, static_cast<int>(i + 1));
+		}
+		lua_setfield(thread, -2, "locals");
+
+		lua_createtable(thread, static_cast<int>(function.upvalue_names.size()), 0);
+		for (size_t i = 0; i < function.upvalue_names.size(); i++) {
+			const char* name = module.string(function.upvalue_names[i]);
+			lua_pushstring(thread, name ? name : "");
+			lua_rawseti(thread, -2, static_cast<int>(i + 1));
+		}
+		lua_setfield(thread, -2, "upvalues");
+	}
+
+	std::vector<int> lines = function.lines();
+	lua_newtable(thread);
+	int count = 0;
+	for (size_t pc = 0; pc < function.code.size(); pc += opcode_length(LUAU_INSN_OP(function.code[pc]))) {
+		push_instruction(thread, function, pc, lines.empty() ? -1 : lines[pc]);
+		lua_rawseti(thread, -2, ++count);
+	}
+	lua_setfield(thread, -2, "instructions");
+}
+
+// Constants, children and instruction pcs keep the 0-based numbering the bytecode uses, so function `id` is `functions[id + 1]`
+int disassemble(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(3);
+	size_t length;
+	const char* bytecode = luaL_checklstring(thread, 1, &length);
+	bytecode_module module;
+	std::string error;
+	if (!read_bytecode(std::string_view(bytecode, length), module, error)) {
+		lua_pushlstring(thread, error.data(), error.size());
+		lua_error(thread);
+		return 0;
+	}
+	lua_createtable(thread, 0, 4);
+	set_bytecode_number(thread, module.version, "version");
+	set_bytecode_number(thread, module.types_version, "types_version");
+	set_bytecode_number(thread, module.main, "main");
+	lua_createtable(thread, static_cast<int>(module.functions.size()), 0);
+	for (size_t id = 0; id < module.functions.size(); id++) {
+		push_function(thread, module, id);
+		lua_rawseti(thread, -2, static_cast<int>(id + 1));
+	}
+	lua_setfield(thread, -2, "functions");
+	return 1;
+}
+
+// Compiler remarks (inlining decisions and allocations) only come out interleaved with the source as `-- remark: ` comments
+void push_remarks(lua_State* thread, const std::string& annotated) {
+	stack_slots_needed(3);
+	constexpr std::string_view prefix = "-- remark: ";
+	lua_newtable(thread);
+	int count = 0;
+	int line = 1;
+	std::vector<std::string_view> pending;
+	size_t start = 0;
+	while (start <= annotated.size()) {
+		size_t end = annotated.find('\n', start);
+		if (end == std::string::npos) {
+			end = annotated.size();
+		}
+		std::string_view text(annotated.data() + start, end - start);
+		size_t indent = text.find_first_not_of(" \t");
+		if (indent != std::string_view::npos && text.substr(indent).starts_with(prefix)) {
+			pending.push_back(text.substr(indent + prefix.size()));
+		} else {
+			for (std::string_view remark : pending) {
+				lua_createtable(thread, 0, 2);
+				set_bytecode_number(thread, line, "line");
+				lua_pushlstring(thread, remark.data(), remark.size());
+				lua_setfield(thread, -2, "message");
+				lua_rawseti(thread, -2, ++count);
+			}
+			pending.clear();
+			line++;
+		}
+		start = end + 1;
+	}
+}
+
+int report(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(4);
+	std::string source = luau::checkstring(thread, 1);
+	compile_options options;
+	if (lua_gettop(thread) >= 2) {
+		check_compile_options(thread, 2, options);
+	}
+	Luau::BytecodeBuilder builder;
+	builder.setDumpFlags(Luau::BytecodeBuilder::Dump_Remarks);
+	builder.setDumpSource(source);
+	std::string error;
+	try {
+		Luau::compileOrThrow(builder, source, options.options);
+	} catch (const std::exception& e) {
+		error = e.what();
+	}
+	if (!error.empty()) {
+		lua_pushlstring(thread, error.data(), error.size());
+		lua_error(thread);
+		return 0;
+	}
+	bytecode_module module;
+	if (!read_bytecode(builder.getBytecode(), module, error)) {
+		lua_pushlstring(thread, error.data(), error.size());
+		lua_error(thread);
+		return 0;
+	}
+
+	lua_createtable(thread, 0, 3);
+	set_bytecode_number(thread, module.main, "main");
+	lua_createtable(thread, static_cast<int>(module.functions.size()), 0);
+	for (size_t id = 0; id < module.functions.size(); id++) {
+		const bytecode_function& function = module.functions[id];
+		std::map<std::string_view, int> counts;
+		int instructions = 0;
+		int closures = 0;
+		int fastcalls = 0;
+		for (size_t pc = 0; pc < function.code.size(); pc += opcode_length(LUAU_INSN_OP(function.code[pc]))) {
+			uint8_t op = LUAU_INSN_OP(function.code[pc]);
+			counts[opcode_name(op)]++;
+			instructions++;
+			if (op == LOP_NEWCLOSURE || op == LOP_DUPCLOSURE) {
+				closures++;
+			} else if (is_fastcall(op)) {
+				fastcalls++;
+			}
+		}
+
+		lua_createtable(thread, 0, 10);
+		set_bytecode_number(thread, static_cast<double>(id), "id");
+		set_bytecode_string(thread, module.string(function.debug_name), "name");
+		set_bytecode_number(thread, function.line_defined, "line_defined");
+		set_bytecode_number(thread, instructions, "instructions");
+		set_bytecode_number(thread, function.max_stack_size, "registers");
+		set_bytecode_number(thread, function.num_upvalues, "upvalues");
+		set_bytecode_number(thread, closures, "closures");
+		set_bytecode_number(thread, fastcalls, "fastcalls");
+		set_bytecode_number(thread, static_cast<double>(function.constants.size()), "constants");
+		lua_createtable(thread, 0, static_cast<int>(counts.size()));
+		for (const auto& [name, count] : counts) {
+			lua_pushinteger(thread, count);
+			lua_setfield(thread, -2, name.data());
+		}
+		lua_setfield(thread, -2, "ops");
+		lua_rawseti(thread, -2, static_cast<int>(id + 1));
+	}
+	lua_setfield(thread, -2, "functions");
+	push_remarks(thread, builder.dumpSourceRemarks());
+	lua_setfield(thread, -2, "remarks");
+	return 1;
+}
+
+// Rebuilds the string table from only the strings something still references, merging duplicates
+void compact_strings(bytecode_module& module) {
+	std::vector<std::string> strings;
+	std::unordered_map<std::string_view, uint32_t> references;
+	std::vector<uint32_t> remap(module.strings.size() + 1, 0);
+	strings.reserve(module.strings.size());
+	auto use = [&](uint32_t& reference) {
+		if (reference == 0) {
+			return;
+		}
+		if (remap[reference] == 0) {
+			const std::string& string = module.strings[reference - 1];
+			auto [it, inserted] = references.try_emplace(string, static_cast<uint32_t>(strings.size() + 1));
+			if (inserted) {
+				strings.push_back(string);
+			}
+			remap[reference] = it->second;
+		}
+		reference = remap[reference];
+	};
+	for (bytecode_function& function : module.functions) {
+		for (bytecode_constant& constant : function.constants) {
+			if (constant.type == LBC_CONSTANT_STRING) {
+				use(constant.index);
+			}
+		}
+		use(function.debug_name);
+		for (bytecode_local& local : function.locals) {
+			use(local.name);
+		}
+		for (uint32_t& name : function.upvalue_names) {
+			use(name);
+		}
+	}
+	for (auto& [index, name] : module.userdata_types) {
+		use(name);
+	}
+	module.strings = std::move(strings);
+}
+
+// strip(bytecode, {debug = true, lines = true}) -> bytecode, bytes_saved
+// `debug` drops function, local and upvalue names, and `lines` drops line info. Either way the string table is
+// compacted afterwards.
+int strip(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(2);
+	size_t length;
+	const char* bytecode = luaL_checklstring(thread, 1, &length);
+	bool strip_debug = true;
+	bool strip_lines = true;
+	if (lua_gettop(thread) >= 2 && !lua_isnil(thread, 2)) {
+		luaL_checktype(thread, 2, LUA_TTABLE);
+		if (lua_getfield(thread, 2, "debug")) {
+			strip_debug = luaL_checkboolean(thread, -1);
+		}
+		lua_pop(thread, 1);
+		if (lua_getfield(thread, 2, "lines")) {
+			strip_lines = luaL_checkboolean(thread, -1);
+		}
+		lua_pop(thread, 1);
+	}
+
+	bytecode_module module;
+	std::string error;
+	if (!read_bytecode(std::string_view(bytecode, length), module, error)) {
+		lua_pushlstring(thread, error.data(), error.size());
+		lua_error(thread);
+		return 0;
+	}
+	for (bytecode_function& function : module.functions) {
+		if (strip_debug) {
+			function.debug_name = 0;
+			function.has_debug_info = false;
+			function.locals.clear();
+			function.upvalue_names.clear();
+		}
+		if (strip_lines) {
+			function.line_defined = 0;
+			function.has_line_info = false;
+			function.line_deltas.clear();
+			function.abs_line_deltas.clear();
+		}
+	}
+	compact_strings(module);
+
+	std::string stripped = write_bytecode(module);
+	luau::pushstring(thread, stripped);
+	lua_pushinteger(thread, static_cast<int>(length) - static_cast<int>(stripped.size()));
+	return 2;
+}
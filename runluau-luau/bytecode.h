@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "luau.h"
+
+// A decoded Luau bytecode blob, kept close to the serialized layout so it can be written back out
+struct bytecode_constant {
+	uint8_t type;
+	bool boolean = false;
+	double number = 0;
+	float vector[4] = {};
+	uint32_t index = 0; // String reference, import id or closure function id depending on the type
+	std::vector<uint32_t> keys; // Constant indices of a table template's keys
+};
+struct bytecode_local {
+	uint32_t name; // String reference
+	uint32_t start_pc;
+	uint32_t end_pc;
+	uint8_t reg;
+};
+struct bytecode_function {
+	uint8_t max_stack_size;
+	uint8_t num_params;
+	uint8_t num_upvalues;
+	uint8_t is_vararg;
+	uint8_t flags = 0;
+	std::string type_info;
+	std::vector<uint32_t> code;
+	std::vector<bytecode_constant> constants;
+	std::vector<uint32_t> children;
+	uint32_t line_defined;
+	uint32_t debug_name; // String reference
+
+	bool has_line_info = false;
+	uint8_t line_gap_log2 = 0;
+	std::vector<uint8_t> line_deltas; // As serialized: deltas between consecutive instructions
+	std::vector<int32_t> abs_line_deltas; // As serialized: deltas between consecutive intervals
+
+	bool has_debug_info = false;
+	std::vector<bytecode_local> locals;
+	std::vector<uint32_t> upvalue_names; // String references
+
+	// Decodes the line of every instruction, or returns an empty vector without line info
+	std::vector<int> lines() const;
+};
+struct bytecode_module {
+	uint8_t version;
+	uint8_t types_version = 0;
+	std::vector<std::string> strings; // String references are 1-based, 0 means none
+	std::vector<std::pair<uint8_t, uint32_t>> userdata_types; // Types version 3 userdata type name remapping
+	std::vector<bytecode_function> functions;
+	uint32_t main;
+
+	const char* string(uint32_t reference) const {
+		return reference ? strings[reference - 1].c_str() : nullptr;
+	}
+};
+
+// Returns false and fills `error` if the blob is malformed or a compile error
+bool read_bytecode(std::string_view data, bytecode_module& module, std::string& error);
+std::string write_bytecode(const bytecode_module& module);
+const char* opcode_name(uint8_t op);
+int opcode_length(uint8_t op);
+
+int disassemble(lua_State* thread);
+int report(lua_State* thread);
+// strip(bytecode, options) -> bytecode, bytes_saved
+int strip(lua_State* thread);
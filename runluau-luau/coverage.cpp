@@ -0,0 +1,165 @@
+#include "pch.h"
+
+#include "coverage.h"
+
+// Line coverage. Bytecode compiled with `coverageLevel` counts hits inside the function prototypes
+// themselves, so counts from every coroutine running the code end up in the same place. Counters
+// can't be reset, so starting takes a baseline and reports are the difference since then.
+struct coverage_function {
+	std::string name;
+	int line_defined;
+	std::vector<int> hits; // Indexed by line, -1 for lines with no code
+};
+struct coverage_chunk {
+	int ref;
+	std::string source;
+	std::vector<coverage_function> baseline;
+	std::vector<coverage_function> stopped; // Filled in by `coverage_stop`
+};
+struct coverage_state {
+	bool running = false;
+	std::vector<coverage_chunk> chunks;
+};
+coverage_state coverage;
+
+void coverage_callback(void* context, const char* function, int line_defined, int depth, const int* hits, size_t size) {
+	std::vector<coverage_function>* functions = static_cast<std::vector<coverage_function>*>(context);
+	std::string name;
+	if (function) {
+		name = function;
+	} else if (depth == 0) {
+		name = "<main>";
+	} else {
+		name = "<anonymous>";
+	}
+	functions->push_back({.name = std::move(name), .line_defined = line_defined, .hits = std::vector<int>(hits, hits + size)});
+}
+std::vector<coverage_function> snapshot_coverage(lua_State* thread, int ref) {
+	std::vector<coverage_function> functions;
+	lua_getref(thread, ref);
+	lua_getcoverage(thread, -1, &functions, coverage_callback);
+	lua_pop(thread, 1);
+	return functions;
+}
+void track_coverage(lua_State* thread, int index, bool take_baseline) {
+	luaL_checktype(thread, index, LUA_TFUNCTION);
+	lua_Debug info;
+	lua_pushvalue(thread, index);
+	lua_getinfo(thread, -1, "s", &info);
+	coverage_chunk chunk{.ref = lua_ref(thread, -1), .source = info.short_src};
+	lua_pop(thread, 1);
+	if (take_baseline) {
+		chunk.baseline = snapshot_coverage(thread, chunk.ref);
+	}
+	coverage.chunks.push_back(std::move(chunk));
+}
+void clear_coverage(lua_State* thread) {
+	for (const coverage_chunk& chunk : coverage.chunks) {
+		lua_unref(thread, chunk.ref);
+	}
+	coverage.chunks.clear();
+}
+
+void coverage_loaded(lua_State* thread, int index) {
+	if (coverage.running) {
+		track_coverage(thread, index, false); // Freshly loaded, so every counter is still 0
+	}
+}
+
+// coverage_start({functions...}) tracks the given functions plus everything `luau.load` or a `luau.loader` require loads
+// until `coverage_stop`. Nothing else is tracked, so code that was already loaded some other way (like the running script)
+// only shows up if its function is passed in.
+int coverage_start(lua_State* thread) {
+	stack_slots_needed(3);
+	clear_coverage(thread);
+	coverage.running = true;
+	if (lua_gettop(thread) >= 1 && !lua_isnil(thread, 1)) {
+		luaL_checktype(thread, 1, LUA_TTABLE);
+		int count = lua_objlen(thread, 1);
+		for (int i = 1; i <= count; i++) {
+			lua_rawgeti(thread, 1, i);
+			track_coverage(thread, lua_gettop(thread), true);
+			lua_pop(thread, 1);
+		}
+	}
+	return 0;
+}
+
+int coverage_stop(lua_State* thread) {
+	stack_slots_needed(1);
+	if (!coverage.running) {
+		lua_pushstring(thread, "Coverage is not being collected");
+		lua_error(thread);
+		return 0;
+	}
+	coverage.running = false;
+	for (coverage_chunk& chunk : coverage.chunks) {
+		chunk.stopped = snapshot_coverage(thread, chunk.ref);
+	}
+	return 0;
+}
+
+// Returns the hits since `coverage_start` as lcov tracefile text
+int coverage_report(lua_State* thread) {
+	stack_slots_needed(1);
+	std::map<std::string, std::map<int, int64_t>> files_lines;
+	// Keyed by line and name, since names alone collide (every anonymous function, or locals shadowing each other)
+	std::map<std::string, std::map<std::pair<int, std::string>, int64_t>> files_functions;
+	for (const coverage_chunk& chunk : coverage.chunks) {
+		std::vector<coverage_function> current = coverage.running ? snapshot_coverage(thread, chunk.ref) : chunk.stopped;
+		auto& lines = files_lines[chunk.source];
+		auto& functions = files_functions[chunk.source];
+		for (size_t f = 0; f < current.size(); f++) {
+			const coverage_function& function = current[f];
+			// Prototypes are always walked in the same order, so the baseline lines up by index
+			const coverage_function* baseline = f < chunk.baseline.size() ? &chunk.baseline[f] : nullptr;
+			for (size_t line = 0; line < function.hits.size(); line++) {
+				if (function.hits[line] < 0) {
+					continue;
+				}
+				int64_t hits = function.hits[line];
+				if (baseline && line < baseline->hits.size() && baseline->hits[line] > 0) {
+					hits -= baseline->hits[line];
+				}
+				lines[static_cast<int>(line)] += hits;
+			}
+			// Calls are counted by the first line with code, since the `function` line itself usually has none
+			int64_t calls = 0;
+			size_t entry = 0;
+			while (entry < function.hits.size() && function.hits[entry] < 0) {
+				entry++;
+			}
+			if (entry < function.hits.size() && function.hits[entry] > 0) {
+				calls = function.hits[entry];
+				if (baseline && entry < baseline->hits.size() && baseline->hits[entry] > 0) {
+					calls -= baseline->hits[entry];
+				}
+			}
+			functions[{function.line_defined, function.name}] += calls;
+		}
+	}
+
+	std::string output;
+	for (const auto& [source, lines] : files_lines) {
+		output += "TN:\nSF:" + source + '\n';
+		const auto& functions = files_functions[source];
+		size_t functions_hit = 0;
+		// lcov matches FNDA to FN by name, so the name carries the line to stay unique
+		for (const auto& [function, calls] : functions) {
+			output += "FN:" + std::to_string(function.first) + ',' + function.second + ':' + std::to_string(function.first) + '\n';
+		}
+		for (const auto& [function, calls] : functions) {
+			output += "FNDA:" + std::to_string(calls) + ',' + function.second + ':' + std::to_string(function.first) + '\n';
+			functions_hit += calls > 0;
+		}
+		output += "FNF:" + std::to_string(functions.size()) + "\nFNH:" + std::to_string(functions_hit) + '\n';
+		size_t lines_hit = 0;
+		for (const auto& [line, hits] : lines) {
+			output += "DA:" + std::to_string(line) + ',' + std::to_string(hits) + '\n';
+			lines_hit += hits > 0;
+		}
+		output += "LF:" + std::to_string(lines.size()) + "\nLH:" + std::to_string(lines_hit) + "\nend_of_record\n";
+	}
+	lua_pushlstring(thread, output.data(), output.size());
+	return 1;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "luau.h"
+
+// Tracks a function returned by `luau.load` or loaded by a `luau.loader` require while coverage is being collected
+void coverage_loaded(lua_State* thread, int index);
+
+int coverage_start(lua_State* thread);
+int coverage_stop(lua_State* thread);
+int coverage_report(lua_State* thread);
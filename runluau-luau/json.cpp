@@ -0,0 +1,891 @@
+#include "pch.h"
+
+#include "json.h"
+#include "util.h"
+
+constexpr const char* DOM_PARSER_KEY = "runluau-json-dom-parser";
+constexpr const char* ARRAY_MT_KEY = "runluau-json-array-mt";
+constexpr const char* OBJECT_MT_KEY = "runluau-json-object-mt";
+constexpr int64_t MAX_SAFE_INTEGER = 9007199254740992; // 2^53
+constexpr size_t MAX_ENCODE_DEPTH = 1000; // Encoding recurses on the C stack, so deep nesting has to be cut off
+char json_null;
+
+// One parser per VM so its internal buffers get reused instead of reallocated on every decode
+simdjson::dom::parser& get_dom_parser(lua_State* thread) {
+	stack_slots_needed(1);
+	lua_getfield(thread, LUA_REGISTRYINDEX, DOM_PARSER_KEY);
+	simdjson::dom::parser* parser = static_cast<simdjson::dom::parser*>(lua_touserdata(thread, -1));
+	lua_pop(thread, 1);
+	if (!parser) {
+		void* memory = lua_newuserdatadtor(thread, sizeof(simdjson::dom::parser), destroy_userdata<simdjson::dom::parser>);
+		parser = new (memory) simdjson::dom::parser();
+		lua_setfield(thread, LUA_REGISTRYINDEX, DOM_PARSER_KEY);
+	}
+	return *parser;
+}
+
+void push_json_int64(lua_State* thread, int64_t value, bool big_integers_as_strings) {
+	if (big_integers_as_strings && (value > MAX_SAFE_INTEGER || value < -MAX_SAFE_INTEGER)) {
+		char digits[24];
+		auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+		lua_pushlstring(thread, digits, end - digits);
+	} else {
+		lua_pushnumber(thread, static_cast<lua_Number>(value));
+	}
+}
+void push_json_uint64(lua_State* thread, uint64_t value, bool big_integers_as_strings) {
+	if (big_integers_as_strings && value > static_cast<uint64_t>(MAX_SAFE_INTEGER)) {
+		char digits[24];
+		auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+		lua_pushlstring(thread, digits, end - digits);
+	} else {
+		lua_pushnumber(thread, static_cast<lua_Number>(value));
+	}
+}
+
+inline void set_json_metatable(lua_State* thread, const char* key) {
+	lua_getfield(thread, LUA_REGISTRYINDEX, key);
+	lua_setmetatable(thread, -2);
+}
+void push_json_element(lua_State* thread, simdjson::dom::element element, const json_decode_options& options) {
+	stack_slots_needed(3);
+	switch (element.type()) {
+	case simdjson::dom::element_type::OBJECT:
+	{
+		simdjson::dom::object object = element.get_object().value_unsafe();
+		lua_createtable(thread, 0, static_cast<int>(object.size()));
+		for (auto [key, value] : object) {
+			lua_pushlstring(thread, key.data(), key.size());
+			push_json_element(thread, value, options);
+			lua_rawset(thread, -3);
+		}
+		if (options.hints) {
+			set_json_metatable(thread, OBJECT_MT_KEY);
+		}
+		break;
+	}
+	case simdjson::dom::element_type::ARRAY:
+	{
+		simdjson::dom::array array = element.get_array().value_unsafe();
+		lua_createtable(thread, static_cast<int>(array.size()), 0);
+		int i = 0;
+		for (simdjson::dom::element value : array) {
+			push_json_element(thread, value, options);
+			lua_rawseti(thread, -2, ++i);
+		}
+		if (options.hints) {
+			set_json_metatable(thread, ARRAY_MT_KEY);
+		}
+		break;
+	}
+	case simdjson::dom::element_type::BOOL:
+		lua_pushboolean(thread, element.get_bool().value_unsafe());
+		break;
+	case simdjson::dom::element_type::STRING:
+	{
+		std::string_view string = element.get_string().value_unsafe();
+		lua_pushlstring(thread, string.data(), string.size());
+		break;
+	}
+	case simdjson::dom::element_type::DOUBLE:
+		lua_pushnumber(thread, element.get_double().value_unsafe());
+		break;
+	case simdjson::dom::element_type::INT64:
+		push_json_int64(thread, element.get_int64().value_unsafe(), options.big_integers_as_strings);
+		break;
+	case simdjson::dom::element_type::UINT64:
+		push_json_uint64(thread, element.get_uint64().value_unsafe(), options.big_integers_as_strings);
+		break;
+	case simdjson::dom::element_type::NULL_VALUE:
+		if (options.null_index) {
+			lua_pushvalue(thread, options.null_index);
+		} else {
+			lua_pushnil(thread);
+		}
+		break;
+	default:
+		[[unlikely]]
+		lua_pushfstring(thread, "<UNKNOWN TYPE %d>", element.type());
+		break;
+	}
+}
+
+// Accepts a string or a buffer at `arg`
+std::string_view check_json_input(lua_State* thread, int arg) {
+	size_t length;
+	if (lua_isbuffer(thread, arg)) {
+		const char* data = static_cast<const char*>(lua_tobuffer(thread, arg, &length));
+		return std::string_view(data, length);
+	}
+	const char* data = luaL_checklstring(thread, arg, &length);
+	return std::string_view(data, length);
+}
+json_decode_options check_json_decode_options(lua_State* thread, int arg) {
+	json_decode_options options;
+	if (lua_gettop(thread) < arg || lua_isnil(thread, arg)) {
+		return options;
+	}
+	luaL_checktype(thread, arg, LUA_TTABLE);
+	if (lua_getfield(thread, arg, "null")) {
+		options.null_index = lua_gettop(thread); // Left on the stack for push_json_element
+	} else {
+		lua_pop(thread, 1);
+	}
+	if (lua_getfield(thread, arg, "hints")) {
+		options.hints = luaL_checkboolean(thread, -1);
+	}
+	lua_pop(thread, 1);
+	if (lua_getfield(thread, arg, "big_integers")) {
+		std::string mode = luaL_checkstring(thread, -1);
+		if (mode == "string") {
+			options.big_integers_as_strings = true;
+		} else if (mode == "number") {
+			options.big_integers_as_strings = false;
+		} else {
+			lua_pushstring(thread, "When decoding, big_integers must be \"string\" or \"number\"");
+			lua_error(thread);
+		}
+	}
+	lua_pop(thread, 1);
+	return options;
+}
+
+int decode(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(2);
+	std::string_view input = check_json_input(thread, 1);
+	json_decode_options options = check_json_decode_options(thread, 2);
+	simdjson::dom::element root;
+	simdjson::error_code error = get_dom_parser(thread).parse(input.data(), input.size()).get(root);
+	if (error) {
+		lua_pushfstring(thread, "Failed to decode JSON: %s", simdjson::error_message(error));
+		lua_error(thread);
+		return 0;
+	}
+	push_json_element(thread, root, options);
+	return 1;
+}
+
+// Finds the first byte at or after `i` that needs escaping, 16 bytes at a time where SSE2 is available
+size_t find_json_escape(const char* data, size_t i, size_t length) {
+#if defined(_M_X64) || defined(_M_IX86)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1F);
+	for (; i + 16 <= length; i += 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i needs_escape = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+			_mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk) // Unsigned chunk <= 0x1F
+		);
+		unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(needs_escape));
+		if (mask) {
+			return i + std::countr_zero(mask);
+		}
+	}
+#endif
+	for (; i < length; i++) {
+		unsigned char c = static_cast<unsigned char>(data[i]);
+		if (c == '"' || c == '\\' || c < 0x20) {
+			return i;
+		}
+	}
+	return length;
+}
+
+struct json_encoder {
+	lua_State* thread;
+	std::string out;
+	bool pretty = false;
+	std::string indent = "\t";
+	std::unordered_set<const void*> encoding; // Tables currently being encoded, for cycle detection
+
+	void write_newline(size_t depth) {
+		if (pretty) {
+			out += '\n';
+			for (size_t i = 0; i < depth; i++) {
+				out += indent;
+			}
+		}
+	}
+	void write_string(const char* data, size_t length) {
+		out.reserve(out.size() + length + 2);
+		out += '"';
+		size_t start = 0;
+		while (start < length) {
+			size_t escape = find_json_escape(data, start, length);
+			out.append(data + start, escape - start);
+			if (escape == length) {
+				break;
+			}
+			unsigned char c = static_cast<unsigned char>(data[escape]);
+			switch (c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\b': out += "\\b"; break;
+			case '\f': out += "\\f"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+			{
+				constexpr char hex[] = "0123456789abcdef";
+				char unicode[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+				out.append(unicode, sizeof(unicode));
+				break;
+			}
+			}
+			start = escape + 1;
+		}
+		out += '"';
+	}
+	void write_number(double value) {
+		if (!std::isfinite(value)) {
+			lua_pushstring(thread, "Cannot encode NaN or infinity as JSON");
+			lua_error(thread);
+		}
+		char digits[32];
+		std::to_chars_result result;
+		if (value == std::floor(value) && std::abs(value) <= static_cast<double>(MAX_SAFE_INTEGER)) {
+			result = std::to_chars(digits, digits + sizeof(digits), static_cast<int64_t>(value));
+		} else {
+			result = std::to_chars(digits, digits + sizeof(digits), value); // Shortest representation that round trips
+		}
+		out.append(digits, result.ptr - digits);
+	}
+	// Returns whether the table at `index` should be written as an array
+	bool is_array(int index, int length) {
+		if (lua_getmetatable(thread, index)) {
+			lua_getfield(thread, LUA_REGISTRYINDEX, ARRAY_MT_KEY);
+			bool array_mt = lua_rawequal(thread, -1, -2);
+			lua_pop(thread, 1);
+			lua_getfield(thread, LUA_REGISTRYINDEX, OBJECT_MT_KEY);
+			bool object_mt = lua_rawequal(thread, -1, -2);
+			lua_pop(thread, 2);
+			if (object_mt) {
+				return false;
+			} else if (array_mt && length == 0) {
+				return true;
+			}
+		}
+		if (length == 0) {
+			return false;
+		}
+		if (lua_rawiter(thread, index, length) >= 0) {
+			lua_pop(thread, 2);
+			return false;
+		}
+		return true;
+	}
+	void write_table(int index, size_t depth) {
+		if (depth >= MAX_ENCODE_DEPTH) {
+			lua_pushfstring(thread, "Cannot encode a table nested deeper than %d levels as JSON", static_cast<int>(MAX_ENCODE_DEPTH));
+			lua_error(thread);
+		}
+		if (!lua_checkstack(thread, 4)) {
+			lua_pushstring(thread, "Cannot encode JSON: stack overflow");
+			lua_error(thread);
+		}
+		const void* table = lua_topointer(thread, index);
+		if (!encoding.insert(table).second) {
+			lua_pushstring(thread, "Cannot encode a table with cyclic references as JSON");
+			lua_error(thread);
+		}
+		int length = lua_objlen(thread, index);
+		if (is_array(index, length)) {
+			out += '[';
+			for (int i = 1; i <= length; i++) {
+				if (i > 1) {
+					out += ',';
+				}
+				write_newline(depth + 1);
+				lua_rawgeti(thread, index, i);
+				write_value(lua_gettop(thread), depth + 1);
+				lua_pop(thread, 1);
+			}
+			if (length > 0) {
+				write_newline(depth);
+			}
+			out += ']';
+		} else {
+			out += '{';
+			bool empty = true;
+			for (int i = 0; i = lua_rawiter(thread, index, i), i >= 0;) {
+				if (!empty) {
+					out += ',';
+				}
+				empty = false;
+				write_newline(depth + 1);
+				switch (lua_type(thread, -2)) {
+				case LUA_TSTRING:
+				{
+					size_t key_length;
+					const char* key = lua_tolstring(thread, -2, &key_length);
+					write_string(key, key_length);
+					break;
+				}
+				case LUA_TNUMBER:
+					out += '"';
+					write_number(lua_tonumber(thread, -2));
+					out += '"';
+					break;
+				default:
+					lua_pushfstring(thread, "Cannot encode a table with %s keys as JSON", luaL_typename(thread, -2));
+					lua_error(thread);
+				}
+				out += pretty ? ": " : ":";
+				write_value(lua_gettop(thread), depth + 1);
+				lua_pop(thread, 2);
+			}
+			if (!empty) {
+				write_newline(depth);
+			}
+			out += '}';
+		}
+		encoding.erase(table);
+	}
+	void write_value(int index, size_t depth) {
+		stack_slots_needed(4);
+		switch (lua_type(thread, index)) {
+		case LUA_TNIL:
+			out += "null";
+			break;
+		case LUA_TBOOLEAN:
+			out += lua_toboolean(thread, index) ? "true" : "false";
+			break;
+		case LUA_TNUMBER:
+			write_number(lua_tonumber(thread, index));
+			break;
+		case LUA_TSTRING:
+		{
+			size_t length;
+			const char* string = lua_tolstring(thread, index, &length);
+			write_string(string, length);
+			break;
+		}
+		case LUA_TBUFFER:
+		{
+			size_t length;
+			const char* data = static_cast<const char*>(lua_tobuffer(thread, index, &length));
+			write_string(data, length);
+			break;
+		}
+		case LUA_TTABLE:
+			write_table(index, depth);
+			break;
+		case LUA_TLIGHTUSERDATA:
+			if (lua_tolightuserdata(thread, index) == &json_null) {
+				out += "null";
+				break;
+			}
+			[[fallthrough]];
+		default:
+			lua_pushfstring(thread, "Cannot encode %s as JSON", luaL_typename(thread, index));
+			lua_error(thread);
+			break;
+		}
+	}
+};
+
+int encode(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(1);
+	json_encoder encoder{.thread = thread};
+	bool as_buffer = false;
+	if (lua_gettop(thread) >= 2 && !lua_isnil(thread, 2)) {
+		luaL_checktype(thread, 2, LUA_TTABLE);
+		if (lua_getfield(thread, 2, "pretty")) {
+			encoder.pretty = luaL_checkboolean(thread, -1);
+		}
+		lua_pop(thread, 1);
+		if (lua_getfield(thread, 2, "indent")) {
+			encoder.indent = luaL_checkstring(thread, -1);
+		}
+		lua_pop(thread, 1);
+		if (lua_getfield(thread, 2, "buffer")) {
+			as_buffer = luaL_checkboolean(thread, -1);
+		}
+		lua_pop(thread, 1);
+	}
+	encoder.out.reserve(256);
+	encoder.write_value(1, 0);
+	if (as_buffer) {
+		void* buffer = lua_newbuffer(thread, encoder.out.size());
+		memcpy(buffer, encoder.out.data(), encoder.out.size());
+	} else {
+		lua_pushlstring(thread, encoder.out.data(), encoder.out.size());
+	}
+	return 1;
+}
+
+// Lazily queried documents. Opening only indexes the structure, and each query walks the index
+// up to the requested value and decodes just that value instead of building the whole tree.
+constexpr const char* DOCUMENT_TYPE = "JsonDocument";
+struct json_document {
+	simdjson::padded_string json;
+	simdjson::ondemand::parser parser;
+	simdjson::ondemand::document document;
+	bool closed = false;
+};
+struct json_document_iterator {
+	json_decode_options options;
+	std::vector<std::string> keys; // Empty when iterating an array
+	std::vector<std::string_view> values; // Raw JSON spans inside the document's padded string
+	size_t position = 0;
+};
+
+json_document* check_json_document(lua_State* thread, int arg) {
+	json_document* doc = static_cast<json_document*>(luaL_checkudata(thread, arg, DOCUMENT_TYPE));
+	if (doc->closed) {
+		lua_pushstring(thread, "JSON document is closed");
+		lua_error(thread);
+	}
+	return doc;
+}
+inline void json_error(lua_State* thread, const char* action, simdjson::error_code error) {
+	lua_pushfstring(thread, "%s: %s", action, simdjson::error_message(error));
+	lua_error(thread);
+}
+// Spans point into the document's padded string, so there is always enough padding after them to parse in place
+void push_json_span(lua_State* thread, std::string_view span, const json_decode_options& options) {
+	simdjson::dom::element element;
+	simdjson::error_code error = get_dom_parser(thread).parse(span.data(), span.size(), false).get(element);
+	if (error) {
+		json_error(thread, "Failed to decode JSON value", error);
+	}
+	push_json_element(thread, element, options);
+}
+simdjson::ondemand::value find_json_value(lua_State* thread, json_document* doc, std::string_view pointer) {
+	simdjson::ondemand::value value;
+	simdjson::error_code error = doc->document.at_pointer(pointer).get(value);
+	if (error) {
+		lua_pushfstring(thread, "Failed to find \"%s\" in JSON document: %s", std::string(pointer).c_str(), simdjson::error_message(error));
+		lua_error(thread);
+	}
+	return value;
+}
+inline std::string_view opt_json_pointer(lua_State* thread, int arg) {
+	size_t length;
+	const char* pointer = luaL_optlstring(thread, arg, "", &length);
+	return std::string_view(pointer, length);
+}
+
+int open_document(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(2);
+	std::string_view input = check_json_input(thread, 1);
+	json_document* doc = static_cast<json_document*>(lua_newuserdatadtor(thread, sizeof(json_document), destroy_userdata<json_document>));
+	new (doc) json_document();
+	doc->json = simdjson::padded_string(input);
+	luaL_getmetatable(thread, DOCUMENT_TYPE);
+	lua_setmetatable(thread, -2);
+	simdjson::error_code error = doc->parser.iterate(doc->json).get(doc->document);
+	if (error) {
+		json_error(thread, "Failed to open JSON document", error);
+		return 0;
+	}
+	return 1;
+}
+
+int document_get(lua_State* thread) {
+	stack_slots_needed(3);
+	json_document* doc = check_json_document(thread, 1);
+	std::string_view pointer = opt_json_pointer(thread, 2);
+	json_decode_options options = check_json_decode_options(thread, 3);
+	std::string_view span;
+	simdjson::error_code error = find_json_value(thread, doc, pointer).raw_json().get(span);
+	if (error) {
+		json_error(thread, "Failed to read JSON value", error);
+		return 0;
+	}
+	push_json_span(thread, span, options);
+	return 1;
+}
+
+int document_type(lua_State* thread) {
+	stack_slots_needed(1);
+	json_document* doc = check_json_document(thread, 1);
+	std::string_view pointer = opt_json_pointer(thread, 2);
+	simdjson::ondemand::json_type type;
+	simdjson::error_code error = find_json_value(thread, doc, pointer).type().get(type);
+	if (error) {
+		json_error(thread, "Failed to read JSON type", error);
+		return 0;
+	}
+	switch (type) {
+	case simdjson::ondemand::json_type::array: lua_pushstring(thread, "array"); break;
+	case simdjson::ondemand::json_type::object: lua_pushstring(thread, "object"); break;
+	case simdjson::ondemand::json_type::number: lua_pushstring(thread, "number"); break;
+	case simdjson::ondemand::json_type::string: lua_pushstring(thread, "string"); break;
+	case simdjson::ondemand::json_type::boolean: lua_pushstring(thread, "boolean"); break;
+	case simdjson::ondemand::json_type::null: lua_pushstring(thread, "null"); break;
+	default: lua_pushstring(thread, "unknown"); break;
+	}
+	return 1;
+}
+
+int document_len(lua_State* thread) {
+	stack_slots_needed(1);
+	json_document* doc = check_json_document(thread, 1);
+	std::string_view pointer = opt_json_pointer(thread, 2);
+	simdjson::ondemand::value value = find_json_value(thread, doc, pointer);
+	simdjson::ondemand::json_type type;
+	simdjson::error_code error = value.type().get(type);
+	size_t count = 0;
+	if (!error) {
+		if (type == simdjson::ondemand::json_type::array) {
+			error = value.count_elements().get(count);
+		} else if (type == simdjson::ondemand::json_type::object) {
+			error = value.count_fields().get(count);
+		} else {
+			lua_pushstring(thread, "Can only get the length of a JSON array or object");
+			lua_error(thread);
+			return 0;
+		}
+	}
+	if (error) {
+		json_error(thread, "Failed to count JSON elements", error);
+		return 0;
+	}
+	lua_pushnumber(thread, static_cast<lua_Number>(count));
+	return 1;
+}
+
+int document_iterator_next(lua_State* thread) {
+	stack_slots_needed(3);
+	json_document_iterator* iterator = static_cast<json_document_iterator*>(lua_touserdata(thread, lua_upvalueindex(1)));
+	json_document* doc = static_cast<json_document*>(lua_touserdata(thread, lua_upvalueindex(2)));
+	if (doc->closed) {
+		lua_pushstring(thread, "JSON document is closed");
+		lua_error(thread);
+		return 0;
+	}
+	if (iterator->position >= iterator->values.size()) {
+		return 0;
+	}
+	size_t position = iterator->position++;
+	json_decode_options options = iterator->options;
+	if (!lua_isnil(thread, lua_upvalueindex(3))) {
+		lua_pushvalue(thread, lua_upvalueindex(3));
+		options.null_index = lua_gettop(thread);
+	}
+	if (iterator->keys.empty()) {
+		lua_pushnumber(thread, static_cast<lua_Number>(position + 1));
+	} else {
+		const std::string& key = iterator->keys[position];
+		lua_pushlstring(thread, key.data(), key.size());
+	}
+	push_json_span(thread, iterator->values[position], options);
+	if (options.null_index) {
+		lua_remove(thread, options.null_index);
+	}
+	return 2;
+}
+// Walks the container once to record where each child is, then decodes one child per step
+int document_iter(lua_State* thread) {
+	stack_slots_needed(4);
+	json_document* doc = check_json_document(thread, 1);
+	std::string_view pointer = opt_json_pointer(thread, 2);
+	json_decode_options options = check_json_decode_options(thread, 3);
+	int null_index = options.null_index;
+	options.null_index = 0;
+	simdjson::ondemand::value value = find_json_value(thread, doc, pointer);
+
+	json_document_iterator* iterator = static_cast<json_document_iterator*>(lua_newuserdatadtor(thread, sizeof(json_document_iterator), destroy_userdata<json_document_iterator>));
+	new (iterator) json_document_iterator();
+	iterator->options = options;
+
+	simdjson::ondemand::json_type type;
+	simdjson::error_code error = value.type().get(type);
+	if (!error && type == simdjson::ondemand::json_type::array) {
+		simdjson::ondemand::array array;
+		if (!(error = value.get_array().get(array))) {
+			for (auto result : array) {
+				simdjson::ondemand::value child;
+				std::string_view span;
+				if ((error = result.get(child)) || (error = child.raw_json().get(span))) {
+					break;
+				}
+				iterator->values.push_back(span);
+			}
+		}
+	} else if (!error && type == simdjson::ondemand::json_type::object) {
+		simdjson::ondemand::object object;
+		if (!(error = value.get_object().get(object))) {
+			for (auto result : object) {
+				simdjson::ondemand::field field;
+				std::string_view key;
+				std::string_view span;
+				if ((error = result.get(field)) || (error = field.unescaped_key().get(key))) {
+					break;
+				}
+				iterator->keys.emplace_back(key);
+				if ((error = field.value().raw_json().get(span))) {
+					break;
+				}
+				iterator->values.push_back(span);
+			}
+		}
+	} else if (!error) {
+		lua_pushstring(thread, "Can only iterate a JSON array or object");
+		lua_error(thread);
+		return 0;
+	}
+	if (error) {
+		json_error(thread, "Failed to iterate JSON value", error);
+		return 0;
+	}
+
+	lua_pushvalue(thread, 1);
+	if (null_index) {
+		lua_pushvalue(thread, null_index);
+	} else {
+		lua_pushnil(thread);
+	}
+	lua_pushcclosure(thread, document_iterator_next, "JsonDocumentIterator", 3);
+	return 1;
+}
+
+int document_close(lua_State* thread) {
+	json_document* doc = check_json_document(thread, 1);
+	doc->closed = true;
+	doc->document = simdjson::ondemand::document();
+	doc->parser = simdjson::ondemand::parser();
+	doc->json = simdjson::padded_string();
+	return 0;
+}
+
+constexpr luaL_Reg document_methods[] = {
+	{"get", document_get},
+	{"type", document_type},
+	{"len", document_len},
+	{"iter", document_iter},
+	{"close", document_close},
+	{NULL, NULL}
+};
+
+// NDJSON streaming. The input is split at the last newline that still leaves SIMDJSON_PADDING
+// readable bytes after it: everything before is parsed in place (straight out of the file mapping
+// or buffer), and only the short remainder gets copied into a padded string.
+struct json_lines {
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+	const char* view = nullptr;
+
+	std::string_view body;
+	simdjson::padded_string tail;
+	int stage = 0; // 0 is the body, 1 is the tail, 2 is done
+
+	simdjson::dom::parser parser;
+	std::optional<simdjson::dom::document_stream> stream;
+	std::optional<simdjson::dom::document_stream::iterator> it;
+	size_t window = simdjson::dom::DEFAULT_BATCH_SIZE;
+	size_t batch_size = 1024;
+	json_decode_options options;
+
+	~json_lines() {
+		it.reset();
+		stream.reset();
+		if (view) {
+			UnmapViewOfFile(view);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+	}
+	void split(std::string_view input) {
+		size_t end = 0;
+		if (input.size() > simdjson::SIMDJSON_PADDING) {
+			size_t newline = input.substr(0, input.size() - simdjson::SIMDJSON_PADDING).rfind('\n');
+			if (newline != std::string_view::npos) {
+				end = newline + 1;
+			}
+		}
+		body = input.substr(0, end);
+		tail = simdjson::padded_string(input.substr(end));
+	}
+	bool at_end() const {
+		return !stream || !(*it != stream->end());
+	}
+	// Sets `done` once both parts are exhausted
+	simdjson::error_code next_stage(bool& done) {
+		it.reset();
+		stream.reset();
+		while (stage < 2) {
+			std::string_view part = stage == 0 ? body : std::string_view(tail.data(), tail.size());
+			stage++;
+			if (part.find_first_not_of(" \t\r\n") == std::string_view::npos) {
+				continue;
+			}
+			simdjson::dom::document_stream new_stream;
+			simdjson::error_code error = parser.parse_many(part.data(), part.size(), window).get(new_stream);
+			if (error) {
+				return error;
+			}
+			stream.emplace(std::move(new_stream));
+			it.emplace(stream->begin());
+			done = false;
+			return simdjson::SUCCESS;
+		}
+		done = true;
+		return simdjson::SUCCESS;
+	}
+};
+
+void map_json_lines_file(lua_State* thread, json_lines* lines, std::filesystem::path path) {
+	if (!resolve_sandbox_path(path)) {
+		lua_pushstring(thread, "Filesystem safe mode: Path traversal detected");
+		lua_error(thread);
+		return;
+	}
+	lines->file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (lines->file == INVALID_HANDLE_VALUE) {
+		lua_pushfstring(thread, "Failed to open file: %d", GetLastError());
+		lua_error(thread);
+		return;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(lines->file, &size)) {
+		lua_pushfstring(thread, "Failed to get file size: %d", GetLastError());
+		lua_error(thread);
+		return;
+	}
+	if (size.QuadPart == 0) {
+		lines->split({}); // CreateFileMapping refuses empty files
+		return;
+	}
+	lines->mapping = CreateFileMappingW(lines->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!lines->mapping) {
+		lua_pushfstring(thread, "Failed to map file: %d", GetLastError());
+		lua_error(thread);
+		return;
+	}
+	lines->view = static_cast<const char*>(MapViewOfFile(lines->mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!lines->view) {
+		lua_pushfstring(thread, "Failed to map file: %d", GetLastError());
+		lua_error(thread);
+		return;
+	}
+	lines->split(std::string_view(lines->view, static_cast<size_t>(size.QuadPart)));
+}
+
+constexpr size_t MAX_BATCH_PREALLOCATION = 4096;
+int lines_next(lua_State* thread) {
+	stack_slots_needed(4);
+	json_lines* lines = static_cast<json_lines*>(lua_touserdata(thread, lua_upvalueindex(1)));
+	json_decode_options options = lines->options;
+	if (!lua_isnil(thread, lua_upvalueindex(2))) {
+		lua_pushvalue(thread, lua_upvalueindex(2));
+		options.null_index = lua_gettop(thread);
+	}
+	// batch_size comes straight from the script, so only preallocate up to a sane amount and let the table grow past it
+	lua_createtable(thread, static_cast<int>(lines->batch_size < MAX_BATCH_PREALLOCATION ? lines->batch_size : MAX_BATCH_PREALLOCATION), 0);
+	int count = 0;
+	while (static_cast<size_t>(count) < lines->batch_size) {
+		if (lines->at_end()) {
+			bool done;
+			simdjson::error_code error = lines->next_stage(done);
+			if (error) {
+				json_error(thread, "Failed to read JSON lines", error);
+				return 0;
+			}
+			if (done) {
+				break;
+			}
+			continue;
+		}
+		simdjson::dom::element element;
+		simdjson::error_code error = (**lines->it).get(element);
+		if (error) {
+			json_error(thread, "Failed to decode JSON line", error);
+			return 0;
+		}
+		push_json_element(thread, element, options);
+		lua_rawseti(thread, -2, ++count);
+		++*lines->it;
+	}
+	if (count == 0) {
+		return 0;
+	}
+	return 1;
+}
+// Returns an iterator yielding tables of up to `batch_size` decoded documents
+int iter_lines(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(4);
+	json_lines* lines = static_cast<json_lines*>(lua_newuserdatadtor(thread, sizeof(json_lines), destroy_userdata<json_lines>));
+	new (lines) json_lines();
+	int lines_index = lua_gettop(thread);
+
+	lines->batch_size = luaL_optunsigned(thread, 2, 1024);
+	if (lines->batch_size == 0) {
+		lua_pushstring(thread, "batch_size must be at least 1");
+		lua_error(thread);
+		return 0;
+	}
+	lines->options = check_json_decode_options(thread, 3);
+	int null_index = lines->options.null_index;
+	lines->options.null_index = 0;
+	if (lua_istable(thread, 3)) {
+		if (lua_getfield(thread, 3, "window")) {
+			lines->window = luaL_checkunsigned(thread, -1);
+		}
+		lua_pop(thread, 1);
+	}
+
+	if (lua_isbuffer(thread, 1)) {
+		size_t length;
+		const char* data = static_cast<const char*>(lua_tobuffer(thread, 1, &length));
+		lines->split(std::string_view(data, length));
+	} else {
+		size_t length;
+		const char* path = luaL_checklstring(thread, 1, &length);
+		map_json_lines_file(thread, lines, std::filesystem::path(std::string(path, length)));
+	}
+
+	lua_pushvalue(thread, lines_index);
+	if (null_index) {
+		lua_pushvalue(thread, null_index);
+	} else {
+		lua_pushnil(thread);
+	}
+	lua_pushvalue(thread, 1); // Keeps a buffer input alive while it's being parsed in place
+	lua_pushcclosure(thread, lines_next, "JsonLinesIterator", 3);
+	return 1;
+}
+
+#define reg(name) {#name, name}
+constexpr luaL_Reg library[] = {
+	reg(decode),
+	reg(encode),
+	{"open", open_document},
+	reg(iter_lines),
+	{NULL, NULL}
+};
+inline void register_json_metatable(lua_State* thread, const char* registry_key, const char* type, const char* field) {
+	lua_newtable(thread);
+	lua_pushstring(thread, type);
+	lua_setfield(thread, -2, "__jsontype");
+	lua_pushvalue(thread, -1);
+	lua_setfield(thread, LUA_REGISTRYINDEX, registry_key);
+	lua_setfield(thread, -2, field);
+}
+void register_json_library(lua_State* thread) {
+	luaL_register(thread, "json", library);
+	lua_pushlightuserdata(thread, &json_null);
+	lua_setfield(thread, -2, "null");
+	register_json_metatable(thread, ARRAY_MT_KEY, "array", "array_mt");
+	register_json_metatable(thread, OBJECT_MT_KEY, "object", "object_mt");
+
+	luaL_newmetatable(thread, DOCUMENT_TYPE);
+	lua_newtable(thread);
+	luaL_register(thread, NULL, document_methods);
+	lua_setfield(thread, -2, "__index");
+	lua_pushstring(thread, DOCUMENT_TYPE);
+	lua_setfield(thread, -2, "__type");
+	lua_pop(thread, 1);
+	lua_pop(thread, 1);
+}
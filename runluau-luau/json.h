@@ -0,0 +1,16 @@
+#pragma once
+
+#include "luau.h"
+#include "simdjson.h"
+
+struct json_decode_options {
+	int null_index = 0; // Stack index of the value JSON null decodes to, or 0 for nil
+	bool hints = false; // Whether decoded arrays/objects get `json.array_mt`/`json.object_mt`
+	bool big_integers_as_strings = true; // Integers outside of +-2^53 can't be represented exactly by a double
+};
+
+void push_json_int64(lua_State* thread, int64_t value, bool big_integers_as_strings = true);
+void push_json_uint64(lua_State* thread, uint64_t value, bool big_integers_as_strings = true);
+void push_json_element(lua_State* thread, simdjson::dom::element element, const json_decode_options& options);
+
+void register_json_library(lua_State* thread);
@@ -1,34 +1,26 @@
 #include "pch.h"
 
+#include "analysis.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "coverage.h"
+#include "json.h"
+#include "parse_session.h"
+#include "printer.h"
+#include "profiler.h"
+#include "query.h"
+#include "require.h"
+#include "util.h"
+
 int compile(lua_State* thread) {
 	wanted_arg_count(1);
 	stack_slots_needed(1);
 	std::string source = luau::checkstring(thread, 1);
-	Luau::CompileOptions options;
-	options.optimizationLevel = 1;
-	options.debugLevel = 1;
+	compile_options options;
 	if (lua_gettop(thread) >= 2) {
-		luaL_checktype(thread, 2, LUA_TTABLE);
-		if (lua_getfield(thread, 2, "optimizationLevel")) {
-			unsigned int value = luaL_checkunsigned(thread, -1);
-			lua_pop(thread, 1);
-			if (value > 2) {
-				lua_pushstring(thread, "When compiling, optimizationLevel must be an integer from 0 to 2");
-				lua_error(thread);
-			}
-			options.optimizationLevel = value;
-		}
-		if (lua_getfield(thread, 2, "debugLevel")) {
-			unsigned int value = luaL_checkunsigned(thread, -1);
-			lua_pop(thread, 1);
-			if (value > 2) {
-				lua_pushstring(thread, "When compiling, debugLevel must be an integer from 0 to 2");
-				lua_error(thread);
-			}
-			options.debugLevel = value;
-		}
+		check_compile_options(thread, 2, options);
 	}
-	std::string bytecode = Luau::compile(source, options, {});
+	std::string bytecode = Luau::compile(source, options.options, {});
 	if (bytecode.data()[0] == '\0') {
 		lua_pushlstring(thread, bytecode.data() + 1, bytecode.size() - 1);
 		lua_error(thread);
@@ -38,6 +30,20 @@ int compile(lua_State* thread) {
 	return 1;
 }
 
+int load(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(1);
+	size_t length;
+	const char* bytecode = luaL_checklstring(thread, 1, &length);
+	const char* chunk_name = luaL_optstring(thread, 2, "=luau.load");
+	if (luau_load(thread, chunk_name, bytecode, length, 0) != 0) {
+		lua_error(thread); // luau_load left the error message on the stack
+		return 0;
+	}
+	coverage_loaded(thread, -1);
+	return 1;
+}
+
 // `set` functions expect a table at top of stack
 inline void set_boolean(lua_State* thread, bool value, const char* field) {
 	lua_pushboolean(thread, value);
@@ -62,120 +68,161 @@ inline void set_string(lua_State* thread, std::string value, const char* field)
 	luau::pushstring(thread, value);
 	lua_setfield(thread, -2, field);
 }
-inline std::string position_to_string(Luau::Position pos) {
-	return std::to_string(pos.line) + ',' + std::to_string(pos.column);
-}
-inline void set_location(lua_State* thread, Luau::Location location, const char* field = "location") {
-	set_string(thread, position_to_string(location.begin) + " - " + position_to_string(location.end), field);
+// Columnar AST export. The buffer is laid out as a u32 node count followed by one u32 array per field:
+// kind, parent, first_child, next_sibling, name_id, then a u32[4] location per node.
+// Nodes are in pre-order so node 0 is the root, and missing links/names are COLUMNAR_NONE.
+// A node's kind name is `ast_kinds[kind + 1]` and its name is `ast_strings[name_id + 1]`.
+constexpr uint32_t COLUMNAR_NONE = 0xFFFFFFFF;
+#define COLUMNAR_KINDS(X) \
+	X(ExprGroup) X(ExprConstantNil) X(ExprConstantBool) X(ExprConstantNumber) X(ExprConstantString) \
+	X(ExprLocal) X(ExprGlobal) X(ExprVarargs) X(ExprCall) X(ExprIndexName) X(ExprIndexExpr) \
+	X(ExprFunction) X(ExprTable) X(ExprUnary) X(ExprBinary) X(ExprTypeAssertion) X(ExprIfElse) \
+	X(ExprInterpString) X(ExprError) \
+	X(StatBlock) X(StatIf) X(StatWhile) X(StatRepeat) X(StatBreak) X(StatContinue) X(StatReturn) \
+	X(StatExpr) X(StatLocal) X(StatFor) X(StatForIn) X(StatAssign) X(StatCompoundAssign) \
+	X(StatFunction) X(StatLocalFunction) X(StatTypeAlias) X(StatTypeFunction) X(StatDeclareGlobal) \
+	X(StatDeclareFunction) X(StatDeclareClass) X(StatError) \
+	X(TypeReference) X(TypeTable) X(TypeFunction) X(TypeTypeof) X(TypeUnion) X(TypeIntersection) \
+	X(TypeSingletonBool) X(TypeSingletonString) X(TypeError) \
+	X(TypePackExplicit) X(TypePackVariadic) X(TypePackGeneric)
+enum columnar_kind : uint32_t {
+#define X(name) CK_##name,
+	COLUMNAR_KINDS(X)
+#undef X
+	CK_Expr,
+	CK_Stat,
+	CK_Type,
+	CK_TypePack,
+	CK_Node,
+};
+const char* columnar_kind_names[] = {
+#define X(name) "Ast" #name,
+	COLUMNAR_KINDS(X)
+#undef X
+	"AstExpr",
+	"AstStat",
+	"AstType",
+	"AstTypePack",
+	"AstNode",
+};
+
+inline std::string_view columnar_name(Luau::AstName name) {
+	return name.value ? std::string_view(name.value) : std::string_view();
 }
-void push_ast(lua_State* thread, const simdjson::dom::element& element) {
-	stack_slots_needed(1);
-	switch (element.type()) {
-	case simdjson::dom::element_type::OBJECT:
-		lua_newtable(thread);
-		stack_slots_needed(2);
-		for (auto [key, value] : element.get_object()) {
-			lua_pushlstring(thread, key.data(), key.size());
-			push_ast(thread, value);
-			lua_settable(thread, -3);
+inline std::string_view columnar_name(Luau::AstNode*) { return {}; } // Nodes without a name
+inline std::string_view columnar_name(Luau::AstExprLocal* node) { return columnar_name(node->local->name); }
+inline std::string_view columnar_name(Luau::AstExprGlobal* node) { return columnar_name(node->name); }
+inline std::string_view columnar_name(Luau::AstExprIndexName* node) { return columnar_name(node->index); }
+inline std::string_view columnar_name(Luau::AstExprConstantString* node) { return std::string_view(node->value.data, node->value.size); }
+inline std::string_view columnar_name(Luau::AstExprFunction* node) { return columnar_name(node->debugname); }
+inline std::string_view columnar_name(Luau::AstStatLocalFunction* node) { return columnar_name(node->name->name); }
+inline std::string_view columnar_name(Luau::AstStatTypeAlias* node) { return columnar_name(node->name); }
+inline std::string_view columnar_name(Luau::AstStatDeclareGlobal* node) { return columnar_name(node->name); }
+inline std::string_view columnar_name(Luau::AstStatDeclareFunction* node) { return columnar_name(node->name); }
+inline std::string_view columnar_name(Luau::AstTypeReference* node) { return columnar_name(node->name); }
+
+struct columnar_ast_visitor : Luau::AstVisitor {
+	std::vector<uint32_t> kinds;
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> first_children;
+	std::vector<uint32_t> next_siblings;
+	std::vector<uint32_t> name_ids;
+	std::vector<Luau::Location> locations;
+	std::vector<std::string_view> strings;
+	std::unordered_map<std::string_view, uint32_t> string_ids;
+
+	uint32_t parent = COLUMNAR_NONE;
+	uint32_t last_child = COLUMNAR_NONE;
+	Luau::AstNode* entering = nullptr;
+
+	uint32_t intern(std::string_view string) {
+		if (string.empty()) {
+			return COLUMNAR_NONE;
 		}
-		break;
-	case simdjson::dom::element_type::ARRAY:
-	{
-		lua_newtable(thread);
-		stack_slots_needed(2);
-		const auto& arr = element.get_array();
-		for (size_t i = 0; i < arr.size(); ++i) {
-			push_size_t(thread, i + 1);
-			push_ast(thread, arr.at(i));
-			lua_settable(thread, -3);
+		auto [it, inserted] = string_ids.try_emplace(string, static_cast<uint32_t>(strings.size()));
+		if (inserted) {
+			strings.push_back(string);
 		}
-		break;
+		return it->second;
 	}
-	case simdjson::dom::element_type::BOOL:
-		lua_pushboolean(thread, element.get_bool().value_unsafe());
-		break;
-	case simdjson::dom::element_type::STRING:
-	{
-		const auto& string = element.get_string().value_unsafe();
-		lua_pushlstring(thread, string.data(), string.size());
-		break;
+	// Records the node, then visits its children with it as the parent. Returning false stops
+	// the outer traversal from visiting the children a second time.
+	bool enter(Luau::AstNode* node, columnar_kind kind, std::string_view name) {
+		if (node == entering) {
+			entering = nullptr;
+			return true;
+		}
+		uint32_t index = static_cast<uint32_t>(kinds.size());
+		kinds.push_back(kind);
+		parents.push_back(parent);
+		first_children.push_back(COLUMNAR_NONE);
+		next_siblings.push_back(COLUMNAR_NONE);
+		name_ids.push_back(intern(name));
+		locations.push_back(node->location);
+		if (last_child != COLUMNAR_NONE) {
+			next_siblings[last_child] = index;
+		} else if (parent != COLUMNAR_NONE) {
+			first_children[parent] = index;
+		}
+
+		uint32_t saved_parent = parent;
+		parent = index;
+		last_child = COLUMNAR_NONE;
+		entering = node;
+		node->visit(this);
+		parent = saved_parent;
+		last_child = index;
+		return false;
 	}
-	case simdjson::dom::element_type::DOUBLE:
-		lua_pushnumber(thread, element.get_double().value_unsafe());
-		break;
-	case simdjson::dom::element_type::INT64:
-	{
-		const auto& string = std::to_string(element.get_int64().value_unsafe());
-		lua_pushlstring(thread, string.data(), string.size());
-		break;
+
+#define X(name) bool visit(Luau::Ast##name* node) override { return enter(node, CK_##name, columnar_name(node)); }
+	COLUMNAR_KINDS(X)
+#undef X
+	bool visit(Luau::AstExpr* node) override { return enter(node, CK_Expr, {}); }
+	bool visit(Luau::AstStat* node) override { return enter(node, CK_Stat, {}); }
+	bool visit(Luau::AstType* node) override { return enter(node, CK_Type, {}); }
+	bool visit(Luau::AstTypePack* node) override { return enter(node, CK_TypePack, {}); }
+	bool visit(Luau::AstNode* node) override { return enter(node, CK_Node, {}); }
+};
+void push_columnar_ast(lua_State* thread, Luau::AstStatBlock* root) {
+	stack_slots_needed(3);
+	columnar_ast_visitor visitor;
+	if (root) {
+		root->visit(&visitor);
 	}
-	case simdjson::dom::element_type::UINT64:
-	{
-		const auto& string = std::to_string(element.get_uint64().value_unsafe());
-		lua_pushlstring(thread, string.data(), string.size());
-		break;
+
+	size_t count = visitor.kinds.size();
+	size_t size = sizeof(uint32_t) * (1 + count * 9);
+	uint32_t* out = static_cast<uint32_t*>(lua_newbuffer(thread, size));
+	*out++ = static_cast<uint32_t>(count);
+	for (const auto* column : {&visitor.kinds, &visitor.parents, &visitor.first_children, &visitor.next_siblings, &visitor.name_ids}) {
+		memcpy(out, column->data(), count * sizeof(uint32_t));
+		out += count;
 	}
-	case simdjson::dom::element_type::NULL_VALUE:
-		lua_pushnil(thread);
-		break;
-	default:
-		[[unlikely]]
-		lua_pushfstring(thread, "<UNKNOWN TYPE %d>", element.type());
-		break;
+	for (const auto& location : visitor.locations) {
+		*out++ = location.begin.line;
+		*out++ = location.begin.column;
+		*out++ = location.end.line;
+		*out++ = location.end.column;
 	}
-}
-// This is what ChatGPT is good for
-std::string replace_outside_quotes(
-	const std::string& input_str,
-	const std::string& search_str,
-	const std::string& replace_str
-) {
-	std::string result;
-	result.reserve(input_str.size());
-
-	bool in_quotes = false;
-	int backslash_count = 0;
-	size_t i = 0;
-
-	while (i < input_str.size()) {
-		char c = input_str[i];
+	lua_setfield(thread, -2, "ast_buffer");
 
-		if (in_quotes) {
-			result.push_back(c);
-
-			if (c == '\\') {
-				backslash_count++;
-			} else {
-				if (c == '"' && (backslash_count % 2 == 0)) {
-					in_quotes = false;
-				}
-				backslash_count = 0;
-			}
-			++i;
-		} else {
-			if (c == '"') {
-				in_quotes = true;
-				result.push_back(c);
-				++i;
-				backslash_count = 0;
-			} else {
-				if (!search_str.empty()
-					&& i + search_str.size() <= input_str.size()
-					&& input_str.compare(i, search_str.size(), search_str) == 0) {
-					result += replace_str;
-					i += search_str.size();
-				} else {
-					result.push_back(c);
-					++i;
-				}
-			}
-		}
+	lua_createtable(thread, static_cast<int>(visitor.strings.size()), 0);
+	for (size_t i = 0; i < visitor.strings.size(); ++i) {
+		lua_pushlstring(thread, visitor.strings[i].data(), visitor.strings[i].size());
+		lua_rawseti(thread, -2, static_cast<int>(i + 1));
 	}
+	lua_setfield(thread, -2, "ast_strings");
 
-	return result;
+	constexpr int kind_count = sizeof(columnar_kind_names) / sizeof(columnar_kind_names[0]);
+	lua_createtable(thread, kind_count, 0);
+	for (int i = 0; i < kind_count; ++i) {
+		lua_pushstring(thread, columnar_kind_names[i]);
+		lua_rawseti(thread, -2, i + 1);
+	}
+	lua_setfield(thread, -2, "ast_kinds");
 }
-bool push_parseresult(lua_State* thread, Luau::ParseResult parsed) {
+bool push_parseresult(lua_State* thread, Luau::ParseResult parsed, bool columnar, bool ast_json) {
 	stack_slots_needed(7);
 	lua_newtable(thread);
 
@@ -201,52 +248,48 @@ bool push_parseresult(lua_State* thread, Luau::ParseResult parsed) {
 		lua_settable(thread, -3);
 	}
 	lua_setfield(thread, -2, "errors");
-	if (parsed.root) {
-		std::string ast_json = Luau::toJson(parsed.root, parsed.commentLocations);
-		ast_json = replace_outside_quotes(ast_json, "-Infinity", "\"-Infinity\"");
-		ast_json = replace_outside_quotes(ast_json, "Infinity", "\"Infinity\"");
-		ast_json = replace_outside_quotes(ast_json, "NaN", "\"NaN\"");
-		set_string(thread, ast_json, "ast_json");
-		simdjson::dom::parser parser;
-		simdjson::dom::element ast;
-		simdjson::error_code error = parser.parse(ast_json).get(ast);
-		if (error) {
-			lua_pushfstring(thread, "Failed to parse Luau's JSON: %s", simdjson::error_message(error));
-			lua_error(thread);
-			return false;
+	if (columnar) {
+		push_columnar_ast(thread, parsed.root);
+	} else if (parsed.root) {
+		if (ast_json) {
+			set_string(thread, ast_to_json(parsed.root, parsed.commentLocations), "ast_json");
 		}
-		push_ast(thread, ast);
+		push_ast(thread, parsed.root, parsed.commentLocations);
 		lua_setfield(thread, -2, "ast");
 	} else {
-		set_string(thread, "{}", "ast_json");
+		if (ast_json) {
+			set_string(thread, "{}", "ast_json");
+		}
 		lua_newtable(thread);
 		lua_setfield(thread, -2, "ast");
 	}
 	return true;
 }
+// parse(source, options) -> {lines, hotcomments, errors, ast}
+// `ast_json = true` also adds Luau's own JSON encoding of the AST as `ast_json`, which is slow to build, so it's off by default.
 int parse(lua_State* thread) {
 	wanted_arg_count(1);
 	stack_slots_needed(1);
 	size_t len;
 	const char* source = luaL_checklstring(thread, 1, &len);
 	Luau::ParseOptions options;
+	bool columnar = false;
+	bool ast_json = false;
 	if (lua_gettop(thread) >= 2) {
-		luaL_checktype(thread, 2, LUA_TTABLE);
-		if (lua_getfield(thread, 2, "allowDeclarationSyntax")) {
-			unsigned int value = luaL_checkboolean(thread, -1);
-			lua_pop(thread, 1);
-			options.allowDeclarationSyntax = value;
+		check_parse_options(thread, 2, options);
+		if (lua_getfield(thread, 2, "columnar")) {
+			columnar = luaL_checkboolean(thread, -1);
 		}
-		if (lua_getfield(thread, 2, "captureComments")) {
-			unsigned int value = luaL_checkboolean(thread, -1);
-			lua_pop(thread, 1);
-			options.captureComments = value;
+		lua_pop(thread, 1);
+		if (lua_getfield(thread, 2, "ast_json")) {
+			ast_json = luaL_checkboolean(thread, -1);
 		}
+		lua_pop(thread, 1);
 	}
 	Luau::Allocator allocator;
 	Luau::AstNameTable names(allocator);
 	Luau::ParseResult parsed = Luau::Parser::parse(source, len, names, allocator, options);
-	if (push_parseresult(thread, parsed)) {
+	if (push_parseresult(thread, parsed, columnar, ast_json)) {
 		return 1;
 	} else {
 		return 0; // errored and already called lua_error
@@ -256,9 +299,28 @@ int parse(lua_State* thread) {
 #define reg(name) {#name, name}
 constexpr luaL_Reg library[] = {
 	reg(compile),
+	reg(load),
 	reg(parse),
+	{"parse_session", create_parse_session},
+	reg(query),
+	reg(format),
+	reg(minify),
+	reg(check),
+	reg(lint),
+	reg(dependencies),
+	reg(profiler_start),
+	reg(profiler_stop),
+	reg(coverage_start),
+	reg(coverage_stop),
+	reg(coverage_report),
+	reg(disassemble),
+	reg(report),
+	reg(strip),
+	reg(loader),
 	{NULL, NULL}
 };
 extern "C" __declspec(dllexport) void register_library(lua_State* thread) {
 	luaL_register(thread, "luau", library);
+	register_json_library(thread);
+	register_parse_session(thread);
 }
\ No newline at end of file
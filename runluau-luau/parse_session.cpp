@@ -0,0 +1,373 @@
+#include "pch.h"
+
+#include "ast.h"
+#include "parse_session.h"
+#include "util.h"
+
+// Incremental parsing. The session keeps every top-level statement's AST, and an edit only reparses
+// the statements it touches plus their neighbours (tokens can join across the whitespace between
+// them). The reparsed text is padded so it sits at the same line and column it has in the file,
+// which keeps its locations absolute, and top-level locals from earlier statements are declared
+// ahead of it so references to them still resolve to locals. Statements after the edit keep their
+// nodes and get their locations moved when they're read.
+//
+// The rest of the file is reparsed too if the edit changes which top-level locals are declared,
+// or leaves a syntax error, since both can change how later statements parse.
+constexpr const char* PARSE_SESSION_TYPE = "ParseSession";
+
+// Owns the nodes from one parse, which stay alive as long as any of its statements do
+struct session_parse {
+	Luau::Allocator allocator;
+	Luau::AstNameTable names;
+	std::vector<std::pair<std::string, Luau::Location>> prefix; // Stand-in declarations of earlier top-level locals
+
+	session_parse() : names(allocator) {}
+};
+struct session_statement {
+	size_t begin;
+	size_t end;
+	Luau::Position parsed_begin; // Where `begin` was when the statement was parsed
+	Luau::AstStat* node;
+	std::shared_ptr<session_parse> parse;
+	std::vector<std::pair<std::string, Luau::Location>> declared; // Top-level locals, in parse coordinates
+};
+
+struct parse_session {
+	std::string source;
+	std::vector<size_t> line_offsets;
+	Luau::ParseOptions options;
+	std::vector<session_statement> statements;
+	std::vector<Luau::ParseError> errors;
+	size_t first_error = SIZE_MAX; // Index of the statement the first error is in
+
+	void index_lines() {
+		line_offsets.clear();
+		line_offsets.push_back(0);
+		for (const char* c = source.data(); (c = static_cast<const char*>(memchr(c, '\n', source.data() + source.size() - c)));) {
+			c++;
+			line_offsets.push_back(c - source.data());
+		}
+	}
+	size_t offset(Luau::Position position) const {
+		if (position.line >= line_offsets.size()) {
+			return source.size();
+		}
+		size_t line_end = position.line + 1 < line_offsets.size() ? line_offsets[position.line + 1] : source.size();
+		size_t result = line_offsets[position.line] + position.column;
+		return result < line_end ? result : line_end;
+	}
+	Luau::Position position(size_t offset) const {
+		size_t line = std::upper_bound(line_offsets.begin(), line_offsets.end(), offset) - line_offsets.begin() - 1;
+		return Luau::Position(static_cast<unsigned int>(line), static_cast<unsigned int>(offset - line_offsets[line]));
+	}
+
+	// Parses source[begin, end) as the statements from index `first` on. Returns false if earlier
+	// top-level locals need declaring but there's no line before the text to do it on.
+	bool parse_region(size_t first, size_t begin, size_t end, std::vector<session_statement>& parsed, std::vector<Luau::ParseError>& parse_errors) {
+		std::vector<std::string> visible;
+		std::unordered_set<std::string> seen;
+		for (size_t i = first; i-- > 0;) {
+			for (auto it = statements[i].declared.rbegin(); it != statements[i].declared.rend(); ++it) {
+				if (seen.insert(it->first).second) {
+					visible.push_back(it->first);
+				}
+			}
+		}
+		Luau::Position start = position(begin);
+		if (!visible.empty() && start.line == 0) {
+			return false;
+		}
+
+		std::shared_ptr<session_parse> parse = std::make_shared<session_parse>();
+		std::string text;
+		if (!visible.empty()) {
+			text = "local ";
+			for (size_t i = 0; i < visible.size(); i++) {
+				if (i) {
+					text += ',';
+				}
+				unsigned int column = static_cast<unsigned int>(text.size());
+				text += visible[i];
+				parse->prefix.emplace_back(visible[i], Luau::Location(Luau::Position(0, column), Luau::Position(0, static_cast<unsigned int>(text.size()))));
+			}
+		}
+		text.append(start.line, '\n');
+		text.append(start.column, ' ');
+		text.append(source, begin, end - begin);
+
+		Luau::ParseResult result = Luau::Parser::parse(text.data(), text.size(), parse->names, parse->allocator, options);
+		for (size_t i = visible.empty() ? 0 : 1; i < result.root->body.size; i++) {
+			Luau::AstStat* node = result.root->body.data[i];
+			session_statement statement{
+				.begin = offset(node->location.begin),
+				.end = offset(node->location.end),
+				.parsed_begin = node->location.begin,
+				.node = node,
+				.parse = parse,
+			};
+			if (Luau::AstStatLocal* local = node->as<Luau::AstStatLocal>()) {
+				for (Luau::AstLocal* var : local->vars) {
+					statement.declared.emplace_back(var->name.value, var->location);
+				}
+			} else if (Luau::AstStatLocalFunction* function = node->as<Luau::AstStatLocalFunction>()) {
+				statement.declared.emplace_back(function->name->name.value, function->name->location);
+			}
+			parsed.push_back(std::move(statement));
+		}
+		parse_errors = std::move(result.errors);
+		return true;
+	}
+
+	// Only how far the statement moved since it was parsed. Declarations are real nodes, so this is all they need.
+	ast_location_map statement_shift(size_t index) const {
+		const session_statement& statement = statements[index];
+		Luau::Position now = position(statement.begin);
+		ast_location_map map;
+		map.first_line = statement.parsed_begin.line;
+		map.lines = static_cast<int>(now.line) - static_cast<int>(statement.parsed_begin.line);
+		map.columns = static_cast<int>(now.column) - static_cast<int>(statement.parsed_begin.column);
+		return map;
+	}
+	ast_location_map statement_map(size_t index) const {
+		const session_statement& statement = statements[index];
+		ast_location_map map = statement_shift(index);
+		// Stand-in declarations point at the real declaration, wherever it is now
+		for (const auto& [name, stand_in] : statement.parse->prefix) {
+			bool found = false;
+			for (size_t i = index; i-- > 0 && !found;) {
+				for (auto it = statements[i].declared.rbegin(); it != statements[i].declared.rend(); ++it) {
+					if (it->first == name) {
+						map.replacements.emplace_back(stand_in, statement_shift(i).apply(it->second));
+						found = true;
+						break;
+					}
+				}
+			}
+		}
+		return map;
+	}
+	void push_statement(lua_State* thread, size_t index) const {
+		ast_location_map map = statement_map(index);
+		push_ast(thread, statements[index].node, {}, &map);
+	}
+};
+
+parse_session* check_parse_session(lua_State* thread, int arg) {
+	return static_cast<parse_session*>(luaL_checkudata(thread, arg, PARSE_SESSION_TYPE));
+}
+Luau::Location check_location(lua_State* thread, int arg) {
+	luaL_checktype(thread, arg, LUA_TTABLE);
+	unsigned int values[4];
+	for (int i = 0; i < 4; i++) {
+		lua_rawgeti(thread, arg, i + 1);
+		values[i] = luaL_checkunsigned(thread, -1);
+		lua_pop(thread, 1);
+	}
+	return Luau::Location(Luau::Position(values[0], values[1]), Luau::Position(values[2], values[3]));
+}
+void set_session_errors(parse_session* session, size_t first, std::vector<Luau::ParseError> errors) {
+	session->first_error = SIZE_MAX;
+	if (!errors.empty()) {
+		size_t error_offset = session->offset(errors.front().getLocation().begin);
+		size_t index = first;
+		while (index + 1 < session->statements.size() && session->statements[index + 1].begin <= error_offset) {
+			index++;
+		}
+		session->first_error = index;
+	}
+	session->errors = std::move(errors);
+}
+
+// parse_session(source, options) -> ParseSession
+int create_parse_session(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(2);
+	size_t length;
+	const char* source = luaL_checklstring(thread, 1, &length);
+	Luau::ParseOptions options;
+	if (lua_gettop(thread) >= 2) {
+		check_parse_options(thread, 2, options);
+	}
+	parse_session* session = static_cast<parse_session*>(lua_newuserdatadtor(thread, sizeof(parse_session), destroy_userdata<parse_session>));
+	new (session) parse_session();
+	luaL_getmetatable(thread, PARSE_SESSION_TYPE);
+	lua_setmetatable(thread, -2);
+	session->options = options;
+	session->source.assign(source, length);
+	session->index_lines();
+	std::vector<Luau::ParseError> errors;
+	session->parse_region(0, 0, length, session->statements, errors);
+	set_session_errors(session, 0, std::move(errors));
+	return 1;
+}
+
+// session:edit({begin_line, begin_column, end_line, end_column}, text) -> {first, removed, inserted, ranges}
+// Statements `first` through `first + removed - 1` were replaced by `inserted` new ones, whose locations are in `ranges`.
+int session_edit(lua_State* thread) {
+	stack_slots_needed(4);
+	parse_session* session = check_parse_session(thread, 1);
+	Luau::Location range = check_location(thread, 2);
+	size_t length;
+	const char* text = luaL_checklstring(thread, 3, &length);
+	size_t edit_begin = session->offset(range.begin);
+	size_t edit_end = session->offset(range.end);
+	if (edit_end < edit_begin) {
+		lua_pushstring(thread, "Edit range ends before it begins");
+		lua_error(thread);
+		return 0;
+	}
+
+	std::vector<session_statement>& statements = session->statements;
+	size_t count = statements.size();
+	// The last statement starting before the edit through the first one ending after it
+	size_t first = std::partition_point(statements.begin(), statements.end(), [&](const session_statement& statement) {
+		return statement.begin < edit_begin;
+	}) - statements.begin();
+	if (first > 0) {
+		first--;
+	}
+	size_t last = std::partition_point(statements.begin(), statements.end(), [&](const session_statement& statement) {
+		return statement.end <= edit_end;
+	}) - statements.begin();
+	if (last >= count) {
+		last = count - 1;
+	}
+	if (last < first) {
+		last = first;
+	}
+	if (session->first_error < count) {
+		first = first < session->first_error ? first : session->first_error;
+		last = count - 1;
+	}
+
+	std::unordered_set<std::string> old_declared;
+	for (size_t i = first; i <= last && i < count; i++) {
+		for (const auto& [name, location] : statements[i].declared) {
+			old_declared.insert(name);
+		}
+	}
+
+	session->source.replace(edit_begin, edit_end - edit_begin, text, length);
+	session->index_lines();
+	ptrdiff_t delta = static_cast<ptrdiff_t>(length) - static_cast<ptrdiff_t>(edit_end - edit_begin);
+	size_t region_begin = count == 0 || first == 0 ? 0 : statements[first].begin;
+	size_t region_end = count == 0 || last == count - 1 ? session->source.size() : statements[last].end + delta;
+
+	std::vector<session_statement> parsed;
+	std::vector<Luau::ParseError> errors;
+	for (;;) {
+		parsed.clear();
+		if (!session->parse_region(first, region_begin, region_end, parsed, errors)) {
+			first = 0;
+			region_begin = 0;
+			continue;
+		}
+		if (region_end == session->source.size()) {
+			break;
+		}
+		std::unordered_set<std::string> new_declared;
+		for (const session_statement& statement : parsed) {
+			for (const auto& [name, location] : statement.declared) {
+				new_declared.insert(name);
+			}
+		}
+		bool ends_chunk = !parsed.empty() && parsed.back().node->is<Luau::AstStatReturn>();
+		if (errors.empty() && !ends_chunk && new_declared == old_declared) {
+			break;
+		}
+		last = count - 1;
+		region_end = session->source.size();
+	}
+
+	size_t removed = count == 0 ? 0 : last - first + 1;
+	for (size_t i = last + 1; i < count; i++) {
+		statements[i].begin += delta;
+		statements[i].end += delta;
+	}
+	statements.erase(statements.begin() + first, statements.begin() + first + removed);
+	statements.insert(statements.begin() + first, std::make_move_iterator(parsed.begin()), std::make_move_iterator(parsed.end()));
+	set_session_errors(session, first, std::move(errors));
+
+	lua_createtable(thread, 0, 4);
+	lua_pushunsigned(thread, static_cast<unsigned int>(first + 1));
+	lua_setfield(thread, -2, "first");
+	lua_pushunsigned(thread, static_cast<unsigned int>(removed));
+	lua_setfield(thread, -2, "removed");
+	lua_pushunsigned(thread, static_cast<unsigned int>(parsed.size()));
+	lua_setfield(thread, -2, "inserted");
+	lua_createtable(thread, static_cast<int>(parsed.size()), 0);
+	for (size_t i = 0; i < parsed.size(); i++) {
+		push_location(thread, statements[first + i].node->location);
+		lua_rawseti(thread, -2, static_cast<int>(i + 1));
+	}
+	lua_setfield(thread, -2, "ranges");
+	return 1;
+}
+
+// session:statement(index) -> ast
+int session_statement_ast(lua_State* thread) {
+	parse_session* session = check_parse_session(thread, 1);
+	unsigned int index = luaL_checkunsigned(thread, 2);
+	if (index < 1 || index > session->statements.size()) {
+		lua_pushfstring(thread, "Statement %d is out of range", index);
+		lua_error(thread);
+		return 0;
+	}
+	session->push_statement(thread, index - 1);
+	return 1;
+}
+// session:statements() -> {ast}
+int session_statements(lua_State* thread) {
+	stack_slots_needed(2);
+	parse_session* session = check_parse_session(thread, 1);
+	lua_createtable(thread, static_cast<int>(session->statements.size()), 0);
+	for (size_t i = 0; i < session->statements.size(); i++) {
+		session->push_statement(thread, i);
+		lua_rawseti(thread, -2, static_cast<int>(i + 1));
+	}
+	return 1;
+}
+int session_count(lua_State* thread) {
+	parse_session* session = check_parse_session(thread, 1);
+	lua_pushunsigned(thread, static_cast<unsigned int>(session->statements.size()));
+	return 1;
+}
+int session_source(lua_State* thread) {
+	parse_session* session = check_parse_session(thread, 1);
+	luau::pushstring(thread, session->source);
+	return 1;
+}
+// session:errors() -> {{message, location}}
+int session_errors(lua_State* thread) {
+	stack_slots_needed(3);
+	parse_session* session = check_parse_session(thread, 1);
+	lua_createtable(thread, static_cast<int>(session->errors.size()), 0);
+	for (size_t i = 0; i < session->errors.size(); i++) {
+		const Luau::ParseError& error = session->errors[i];
+		lua_createtable(thread, 0, 2);
+		luau::pushstring(thread, error.getMessage());
+		lua_setfield(thread, -2, "message");
+		set_location(thread, error.getLocation());
+		lua_rawseti(thread, -2, static_cast<int>(i + 1));
+	}
+	return 1;
+}
+
+constexpr luaL_Reg session_methods[] = {
+	{"edit", session_edit},
+	{"statement", session_statement_ast},
+	{"statements", session_statements},
+	{"count", session_count},
+	{"source", session_source},
+	{"errors", session_errors},
+	{NULL, NULL}
+};
+void register_parse_session(lua_State* thread) {
+	luaL_newmetatable(thread, PARSE_SESSION_TYPE);
+	lua_newtable(thread);
+	luaL_register(thread, NULL, session_methods);
+	lua_setfield(thread, -2, "__index");
+	lua_pushstring(thread, PARSE_SESSION_TYPE);
+	lua_setfield(thread, -2, "__type");
+	lua_pop(thread, 1);
+}
\ No newline at end of file
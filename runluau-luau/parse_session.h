@@ -0,0 +1,7 @@
+#pragma once
+
+#include "luau.h"
+
+// parse_session(source, options) -> ParseSession
+int create_parse_session(lua_State* thread);
+void register_parse_session(lua_State* thread);
@@ -2,6 +2,25 @@
 
 #include <stdio.h>
 #include <Windows.h>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "luau.h"
 
@@ -9,6 +28,15 @@
 #include <Luau/Ast.h>
 #include <Luau/Parser.h>
 #include <Luau/Compiler.h>
+#include <Luau/Bytecode.h>
+#include <Luau/BytecodeBuilder.h>
+#include <Luau/BytecodeUtils.h>
 #include <Luau/AstJsonEncoder.h>
+#include <Luau/BuiltinDefinitions.h>
+#include <Luau/Config.h>
+#include <Luau/Error.h>
+#include <Luau/Frontend.h>
+#include <Luau/Linter.h>
+#include <Luau/TypeArena.h>
 
 #include "simdjson.h"
\ No newline at end of file
@@ -0,0 +1,921 @@
+#include "pch.h"
+
+#include "printer.h"
+#include "util.h"
+
+// Source printer for `format` and `minify`, writing straight from the AST into one buffer.
+//
+// Formatting reindents everything and normalizes spacing, but copies anything the bytecode
+// doesn't care about verbatim from the source: comments, type annotations, type declarations and
+// the spelling of string and number literals.
+//
+// Minifying drops comments (except hot comments, which change how the module compiles), types
+// and redundant parentheses, and renames locals. A local's new name is picked by how many locals
+// are live when it's declared, so two locals that are visible at the same time can never share a
+// name, and names that are used as globals anywhere in the file are never handed out.
+struct global_name_visitor : Luau::AstVisitor {
+	std::unordered_set<std::string>& names;
+
+	global_name_visitor(std::unordered_set<std::string>& names) : names(names) {}
+	bool visit(Luau::AstExprGlobal* node) override {
+		names.insert(node->name.value);
+		return true;
+	}
+};
+
+constexpr const char* KEYWORDS[] = {
+	"and", "break", "do", "else", "elseif", "end", "false", "for", "function", "if", "in", "local", "nil", "not", "or",
+	"repeat", "return", "then", "true", "until", "while",
+};
+// Never given to renamed locals: contextual keywords and the implicit method parameter
+constexpr const char* RESERVED_LOCAL_NAMES[] = {"continue", "export", "type", "self"};
+
+inline bool is_name_char(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Binding power on each side of a binary operator, the same as Luau's parser uses
+void binary_priority(Luau::AstExprBinary::Op op, int& left, int& right, const char*& text) {
+	using Op = Luau::AstExprBinary::Op;
+	switch (op) {
+	case Op::Add: left = 6, right = 6, text = "+"; break;
+	case Op::Sub: left = 6, right = 6, text = "-"; break;
+	case Op::Mul: left = 7, right = 7, text = "*"; break;
+	case Op::Div: left = 7, right = 7, text = "/"; break;
+	case Op::FloorDiv: left = 7, right = 7, text = "//"; break;
+	case Op::Mod: left = 7, right = 7, text = "%"; break;
+	case Op::Pow: left = 10, right = 9, text = "^"; break;
+	case Op::Concat: left = 5, right = 4, text = ".."; break;
+	case Op::CompareNe: left = 3, right = 3, text = "~="; break;
+	case Op::CompareEq: left = 3, right = 3, text = "=="; break;
+	case Op::CompareLt: left = 3, right = 3, text = "<"; break;
+	case Op::CompareLe: left = 3, right = 3, text = "<="; break;
+	case Op::CompareGt: left = 3, right = 3, text = ">"; break;
+	case Op::CompareGe: left = 3, right = 3, text = ">="; break;
+	case Op::And: left = 2, right = 2, text = "and"; break;
+	case Op::Or: left = 1, right = 1, text = "or"; break;
+	default: left = 0, right = 0, text = "?"; break;
+	}
+}
+constexpr int UNARY_PRIORITY = 8;
+constexpr int NO_OPERATOR = -1;
+
+inline bool is_multiple_results(Luau::AstExpr* expr) {
+	return expr->is<Luau::AstExprCall>() || expr->is<Luau::AstExprVarargs>();
+}
+inline bool is_prefix(Luau::AstExpr* expr) {
+	return expr->is<Luau::AstExprLocal>() || expr->is<Luau::AstExprGlobal>() || expr->is<Luau::AstExprCall>()
+		|| expr->is<Luau::AstExprIndexName>() || expr->is<Luau::AstExprIndexExpr>();
+}
+bool is_identifier(std::string_view name) {
+	if (name.empty() || (name[0] >= '0' && name[0] <= '9')) {
+		return false;
+	}
+	for (char c : name) {
+		if (!is_name_char(c)) {
+			return false;
+		}
+	}
+	for (const char* keyword : KEYWORDS) {
+		if (name == keyword) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct ast_printer {
+	std::string_view source;
+	bool minify;
+	bool rename;
+	std::string indent_unit;
+	std::string out;
+
+	std::vector<size_t> line_offsets;
+	int depth = 0;
+	bool last_number = false;
+
+	const std::vector<Luau::Comment>* comments = nullptr;
+	size_t next_comment = 0;
+	unsigned int last_line = 0;
+	bool block_start = true;
+
+	std::unordered_set<std::string> reserved;
+	std::vector<std::string> local_names;
+	size_t names_generated = 0;
+	std::unordered_map<Luau::AstLocal*, size_t> renamed; // Index into local_names
+	size_t live_locals = 0;
+
+	ast_printer(std::string_view source, bool minify) : source(source), minify(minify), rename(minify), indent_unit("\t") {
+		line_offsets.push_back(0);
+		for (size_t i = 0; i < source.size(); i++) {
+			if (source[i] == '\n') {
+				line_offsets.push_back(i + 1);
+			}
+		}
+		out.reserve(source.size());
+	}
+
+	std::string_view slice(Luau::Position begin, Luau::Position end) const {
+		if (begin.line >= line_offsets.size() || end.line >= line_offsets.size()) {
+			return {};
+		}
+		size_t from = line_offsets[begin.line] + begin.column;
+		size_t to = line_offsets[end.line] + end.column;
+		if (from > to || to > source.size()) {
+			return {};
+		}
+		return source.substr(from, to - from);
+	}
+	std::string_view slice(Luau::Location location) const {
+		return slice(location.begin, location.end);
+	}
+	// Source text that's printed as is brings its comments along, so they mustn't be printed again
+	void copy(Luau::Location location) {
+		token(slice(location));
+		skip_comments_before(location.end);
+	}
+
+	// Output. `token` adds a space wherever two tokens would otherwise lex as something else.
+	void token(std::string_view text) {
+		if (!out.empty() && !text.empty()) {
+			char last = out.back();
+			char first = text.front();
+			if ((is_name_char(last) && is_name_char(first)) || (last == '-' && first == '-') || (last == '.' && first == '.')
+				|| (last_number && first == '.') || (last == '[' && (first == '[' || first == '='))) {
+				out += ' ';
+			}
+		}
+		out += text;
+		last_number = false;
+	}
+	void number_token(std::string_view text) {
+		token(text);
+		last_number = true;
+	}
+	void space() {
+		if (!minify) {
+			out += ' ';
+		}
+	}
+	void comma() {
+		token(",");
+		space();
+	}
+	void begin_line(unsigned int source_line) {
+		if (minify) {
+			return;
+		}
+		if (!out.empty()) {
+			out += '\n';
+			if (!block_start && source_line > last_line + 1) {
+				out += '\n';
+			}
+		}
+		for (int i = 0; i < depth; i++) {
+			out += indent_unit;
+		}
+		block_start = false;
+	}
+
+	// Comments, which only `format` keeps
+	void comments_before(Luau::Position position) {
+		if (!comments) {
+			return;
+		}
+		while (next_comment < comments->size() && (*comments)[next_comment].location.begin < position) {
+			const Luau::Comment& comment = (*comments)[next_comment++];
+			begin_line(comment.location.begin.line);
+			out += slice(comment.location);
+			last_line = comment.location.end.line;
+		}
+	}
+	void trailing_comment(unsigned int line) {
+		if (comments && next_comment < comments->size() && (*comments)[next_comment].location.begin.line == line) {
+			const Luau::Comment& comment = (*comments)[next_comment++];
+			out += ' ';
+			out += slice(comment.location);
+			last_line = comment.location.end.line;
+		}
+	}
+	void skip_comments_before(Luau::Position position) {
+		while (comments && next_comment < comments->size() && (*comments)[next_comment].location.begin < position) {
+			next_comment++;
+		}
+	}
+	bool has_comments_before(Luau::Position position) const {
+		return comments && next_comment < comments->size() && (*comments)[next_comment].location.begin < position;
+	}
+
+	// Locals
+	const std::string& local_name(size_t index) {
+		while (local_names.size() <= index) {
+			// Names are counted through in length order: a..Z_, then aa..Z_9 and so on
+			constexpr std::string_view first_chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+			constexpr std::string_view chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+			std::string name;
+			size_t n = names_generated++;
+			name += first_chars[n % first_chars.size()];
+			n /= first_chars.size();
+			while (n > 0) {
+				n--;
+				name += chars[n % chars.size()];
+				n /= chars.size();
+			}
+			if (!reserved.contains(name)) {
+				local_names.push_back(std::move(name));
+			}
+		}
+		return local_names[index];
+	}
+	void declare(Luau::AstLocal* local, size_t slot) {
+		if (rename && std::string_view(local->name.value) != "self") {
+			local_name(slot);
+			renamed[local] = slot;
+		}
+	}
+	void local(Luau::AstLocal* local) {
+		auto it = renamed.find(local);
+		token(it != renamed.end() ? std::string_view(local_names[it->second]) : std::string_view(local->name.value));
+	}
+	void local_with_annotation(Luau::AstLocal* variable) {
+		local(variable);
+		if (!minify && variable->annotation) {
+			token(":");
+			space();
+			copy(variable->annotation->location);
+		}
+	}
+
+	// Literals
+	void string(const Luau::AstArray<char>& value) {
+		std::string_view text(value.data, value.size);
+		char quote = std::count(text.begin(), text.end(), '"') > std::count(text.begin(), text.end(), '\'') ? '\'' : '"';
+		std::string escaped(1, quote);
+		for (size_t i = 0; i < text.size(); i++) {
+			escape_char(escaped, text, i, quote);
+		}
+		escaped += quote;
+		token(escaped);
+	}
+	void escape_char(std::string& escaped, std::string_view text, size_t i, char quote) {
+		unsigned char c = static_cast<unsigned char>(text[i]);
+		if (c == '\\' || c == static_cast<unsigned char>(quote)) {
+			escaped += '\\';
+			escaped += static_cast<char>(c);
+		} else if (c == '\n') {
+			escaped += "\\n";
+		} else if (c == '\r') {
+			escaped += "\\r";
+		} else if (c == '\t') {
+			escaped += "\\t";
+		} else if (c < 32 || c == 127) {
+			// Decimal escapes take up to three digits, so pad them if a digit follows
+			char buffer[8];
+			bool digit_follows = i + 1 < text.size() && text[i + 1] >= '0' && text[i + 1] <= '9';
+			snprintf(buffer, sizeof(buffer), digit_follows ? "\\%03d" : "\\%d", c);
+			escaped += buffer;
+		} else {
+			escaped += static_cast<char>(c);
+		}
+	}
+	void number(Luau::AstExprConstantNumber* node) {
+		std::string_view original = slice(node->location);
+		if (!minify || !std::isfinite(node->value)) {
+			number_token(original);
+			return;
+		}
+		char buffer[32];
+		std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), node->value);
+		std::string shortest(buffer, result.ptr);
+		size_t exponent = shortest.find("e+");
+		if (exponent != std::string::npos) {
+			shortest.erase(exponent + 1, 1);
+		}
+		number_token(!original.empty() && original.size() < shortest.size() ? original : std::string_view(shortest));
+	}
+	void interpolated_string(Luau::AstExprInterpString* node) {
+		std::string text = "`";
+		for (size_t i = 0; i < node->strings.size; i++) {
+			std::string_view part(node->strings.data[i].data, node->strings.data[i].size);
+			for (size_t j = 0; j < part.size(); j++) {
+				if (part[j] == '{') {
+					text += "\\{";
+				} else {
+					escape_char(text, part, j, '`');
+				}
+			}
+			if (i < node->expressions.size) {
+				text += '{';
+				token(text);
+				text.clear();
+				// `{{` isn't allowed, so a table constructor goes in parentheses
+				Luau::AstExpr* expression = node->expressions.data[i];
+				if (expression->is<Luau::AstExprTable>()) {
+					token("(");
+					expr(expression, NO_OPERATOR);
+					token(")");
+				} else {
+					expr(expression, NO_OPERATOR);
+				}
+				text += '}';
+			}
+		}
+		text += '`';
+		token(text);
+	}
+
+	// Expressions. `limit` is the binding power of the operator to the left of the expression, or
+	// NO_OPERATOR when it's not an operand at all.
+	void expr(Luau::AstExpr* node, int limit) {
+		if (Luau::AstExprGroup* group = node->as<Luau::AstExprGroup>()) {
+			// Parentheses around a call or `...` truncate it to one value, so those always stay
+			if (minify && !is_multiple_results(group->expr)) {
+				expr(group->expr, limit);
+			} else {
+				token("(");
+				expr(group->expr, NO_OPERATOR);
+				token(")");
+			}
+		} else if (node->is<Luau::AstExprConstantNil>()) {
+			token("nil");
+		} else if (Luau::AstExprConstantBool* boolean = node->as<Luau::AstExprConstantBool>()) {
+			token(boolean->value ? "true" : "false");
+		} else if (Luau::AstExprConstantNumber* number_node = node->as<Luau::AstExprConstantNumber>()) {
+			number(number_node);
+		} else if (Luau::AstExprConstantString* string_node = node->as<Luau::AstExprConstantString>()) {
+			if (minify) {
+				string(string_node->value);
+			} else {
+				token(slice(string_node->location));
+			}
+		} else if (Luau::AstExprLocal* local_node = node->as<Luau::AstExprLocal>()) {
+			local(local_node->local);
+		} else if (Luau::AstExprGlobal* global = node->as<Luau::AstExprGlobal>()) {
+			token(global->name.value);
+		} else if (node->is<Luau::AstExprVarargs>()) {
+			token("...");
+		} else if (Luau::AstExprCall* call = node->as<Luau::AstExprCall>()) {
+			prefix(call->func);
+			token("(");
+			list(call->args);
+			token(")");
+		} else if (Luau::AstExprIndexName* index_name = node->as<Luau::AstExprIndexName>()) {
+			prefix(index_name->expr);
+			token(std::string_view(&index_name->op, 1));
+			token(index_name->index.value);
+		} else if (Luau::AstExprIndexExpr* index_expr = node->as<Luau::AstExprIndexExpr>()) {
+			prefix(index_expr->expr);
+			Luau::AstExprConstantString* key = index_expr->index->as<Luau::AstExprConstantString>();
+			if (minify && key && is_identifier(std::string_view(key->value.data, key->value.size))) {
+				token(".");
+				token(std::string_view(key->value.data, key->value.size));
+			} else {
+				token("[");
+				expr(index_expr->index, NO_OPERATOR);
+				token("]");
+			}
+		} else if (Luau::AstExprFunction* function = node->as<Luau::AstExprFunction>()) {
+			attributes(function);
+			token("function");
+			if (!minify && function->argLocation) {
+				Luau::Position after_keyword = function->location.begin;
+				after_keyword.column += 8;
+				if (slice(function->location.begin, function->argLocation->begin).starts_with("function")) {
+					generics(after_keyword, function->argLocation->begin);
+				}
+			}
+			function_body(function);
+		} else if (Luau::AstExprTable* table = node->as<Luau::AstExprTable>()) {
+			table_constructor(table);
+		} else if (Luau::AstExprUnary* unary = node->as<Luau::AstExprUnary>()) {
+			switch (unary->op) {
+			case Luau::AstExprUnary::Not: token("not"); break;
+			case Luau::AstExprUnary::Minus: token("-"); break;
+			case Luau::AstExprUnary::Len: token("#"); break;
+			}
+			if (unary->op == Luau::AstExprUnary::Not) {
+				space();
+			}
+			expr(unary->expr, UNARY_PRIORITY);
+		} else if (Luau::AstExprBinary* binary = node->as<Luau::AstExprBinary>()) {
+			int left, right;
+			const char* text;
+			binary_priority(binary->op, left, right, text);
+			bool parenthesize = left <= limit;
+			if (parenthesize) {
+				token("(");
+			}
+			left_operand(binary->left, left);
+			space();
+			token(text);
+			space();
+			expr(binary->right, right);
+			if (parenthesize) {
+				token(")");
+			}
+		} else if (Luau::AstExprTypeAssertion* assertion = node->as<Luau::AstExprTypeAssertion>()) {
+			if (minify) {
+				// The assertion also truncated a call or `...` to one value
+				if (is_multiple_results(assertion->expr)) {
+					token("(");
+					expr(assertion->expr, NO_OPERATOR);
+					token(")");
+				} else {
+					expr(assertion->expr, limit);
+				}
+			} else {
+				bool parenthesize = limit != NO_OPERATOR;
+				if (parenthesize) {
+					token("(");
+				}
+				expr(assertion->expr, UNARY_PRIORITY);
+				space();
+				token("::");
+				space();
+				copy(assertion->annotation->location);
+				if (parenthesize) {
+					token(")");
+				}
+			}
+		} else if (Luau::AstExprIfElse* if_else = node->as<Luau::AstExprIfElse>()) {
+			// The else branch would swallow any operator after it
+			bool parenthesize = limit != NO_OPERATOR;
+			if (parenthesize) {
+				token("(");
+			}
+			token("if");
+			for (;;) {
+				space();
+				expr(if_else->condition, NO_OPERATOR);
+				space();
+				token("then");
+				space();
+				expr(if_else->trueExpr, NO_OPERATOR);
+				space();
+				Luau::AstExprIfElse* next = if_else->falseExpr->as<Luau::AstExprIfElse>();
+				if (!next) {
+					break;
+				}
+				token("elseif");
+				if_else = next;
+			}
+			token("else");
+			space();
+			expr(if_else->falseExpr, NO_OPERATOR);
+			if (parenthesize) {
+				token(")");
+			}
+		} else if (Luau::AstExprInterpString* interpolated = node->as<Luau::AstExprInterpString>()) {
+			interpolated_string(interpolated);
+		} else {
+			copy(node->location);
+		}
+	}
+	// Left operands bind the other way: `(a + b) * c` needs parentheses because `*` would pull `b` away from `a`
+	void left_operand(Luau::AstExpr* node, int op_left) {
+		// Minify drops redundant parentheses, so decide by what they contain
+		while (minify && node->is<Luau::AstExprGroup>() && !is_multiple_results(node->as<Luau::AstExprGroup>()->expr)) {
+			node = node->as<Luau::AstExprGroup>()->expr;
+		}
+		bool operation = false;
+		bool parenthesize = false;
+		if (Luau::AstExprBinary* binary = node->as<Luau::AstExprBinary>()) {
+			int left, right;
+			const char* text;
+			binary_priority(binary->op, left, right, text);
+			operation = true;
+			parenthesize = right < op_left;
+		} else if (node->is<Luau::AstExprUnary>()) {
+			operation = true;
+			parenthesize = UNARY_PRIORITY < op_left;
+		}
+		if (parenthesize) {
+			token("(");
+			expr(node, NO_OPERATOR);
+			token(")");
+		} else if (operation) {
+			// Already known to bind tight enough, and `expr` would otherwise wrap `a + b` in `(a + b) + c` again
+			expr(node, NO_OPERATOR);
+		} else {
+			expr(node, op_left);
+		}
+	}
+	// Calls and indexing only apply to names, calls, indexing and parenthesized expressions
+	void prefix(Luau::AstExpr* node) {
+		if (Luau::AstExprGroup* group = node->as<Luau::AstExprGroup>()) {
+			if (minify && !is_multiple_results(group->expr)) {
+				prefix(group->expr);
+				return;
+			}
+			expr(node, NO_OPERATOR);
+		} else if (is_prefix(node)) {
+			expr(node, NO_OPERATOR);
+		} else {
+			token("(");
+			expr(node, NO_OPERATOR);
+			token(")");
+		}
+	}
+	void list(const Luau::AstArray<Luau::AstExpr*>& expressions) {
+		for (size_t i = 0; i < expressions.size; i++) {
+			if (i) {
+				comma();
+			}
+			expr(expressions.data[i], NO_OPERATOR);
+		}
+	}
+	void table_constructor(Luau::AstExprTable* table) {
+		token("{");
+		bool multiline = !minify && table->items.size && table->location.begin.line != table->location.end.line;
+		if (multiline) {
+			depth++;
+			block_start = true;
+		}
+		for (size_t i = 0; i < table->items.size; i++) {
+			const Luau::AstExprTable::Item& item = table->items.data[i];
+			if (multiline) {
+				Luau::Position begin = item.key ? item.key->location.begin : item.value->location.begin;
+				comments_before(begin);
+				begin_line(begin.line);
+			} else if (i) {
+				comma();
+			}
+			Luau::AstExprConstantString* key = item.key ? item.key->as<Luau::AstExprConstantString>() : nullptr;
+			if (item.kind == Luau::AstExprTable::Item::Record
+				|| (minify && item.kind == Luau::AstExprTable::Item::General && key && is_identifier(std::string_view(key->value.data, key->value.size)))) {
+				token(std::string_view(key->value.data, key->value.size));
+				space();
+				token("=");
+				space();
+			} else if (item.kind == Luau::AstExprTable::Item::General) {
+				token("[");
+				expr(item.key, NO_OPERATOR);
+				token("]");
+				space();
+				token("=");
+				space();
+			}
+			expr(item.value, NO_OPERATOR);
+			if (multiline) {
+				token(",");
+				last_line = item.value->location.end.line;
+				trailing_comment(last_line);
+			}
+		}
+		if (multiline) {
+			comments_before(table->location.end);
+			depth--;
+			block_start = true;
+			begin_line(table->location.end.line);
+		}
+		token("}");
+	}
+
+	// Functions
+	void attributes(Luau::AstExprFunction* function) {
+		for (Luau::AstAttr* attribute : function->attributes) {
+			copy(attribute->location);
+			out += ' ';
+		}
+	}
+	// Whatever is between a function's name and its arguments, which is the generic list if there is one
+	void generics(Luau::Position from, Luau::Position to) {
+		std::string_view text = slice(from, to);
+		size_t begin = text.find_first_not_of(" \t\r\n");
+		if (begin != std::string_view::npos && text[begin] == '<') {
+			size_t end = text.rfind('>'); // Leaves out any comment after the list
+			token(text.substr(begin, end - begin + 1));
+			skip_comments_before(to);
+		}
+	}
+	void function_body(Luau::AstExprFunction* function) {
+		size_t saved_live = live_locals;
+		token("(");
+		if (function->self) {
+			declare(function->self, live_locals++);
+		}
+		for (size_t i = 0; i < function->args.size; i++) {
+			if (i) {
+				comma();
+			}
+			declare(function->args.data[i], live_locals++);
+			local_with_annotation(function->args.data[i]);
+		}
+		if (function->vararg) {
+			if (function->args.size) {
+				comma();
+			}
+			token("...");
+			if (!minify && function->varargAnnotation) {
+				token(":");
+				space();
+				copy(function->varargAnnotation->location);
+			}
+		}
+		token(")");
+		if (!minify && function->argLocation && function->returnAnnotation) {
+			// Runs up to the body, less any comments after the last type
+			Luau::Position type_end = function->argLocation->end;
+			for (Luau::AstType* type : function->returnAnnotation->types) {
+				type_end = type_end < type->location.end ? type->location.end : type_end;
+			}
+			if (function->returnAnnotation->tailType && type_end < function->returnAnnotation->tailType->location.end) {
+				type_end = function->returnAnnotation->tailType->location.end;
+			}
+			Luau::Position annotation_end = function->body->location.begin;
+			for (size_t i = next_comment; comments && i < comments->size(); i++) {
+				const Luau::Location& comment = (*comments)[i].location;
+				if (!(comment.begin < annotation_end)) {
+					break;
+				}
+				if (!(comment.begin < type_end)) {
+					annotation_end = comment.begin;
+				}
+			}
+			std::string_view annotation = slice(function->argLocation->end, annotation_end);
+			size_t begin = annotation.find_first_not_of(" \t\r\n");
+			if (begin != std::string_view::npos && annotation[begin] == ':') {
+				size_t end = annotation.find_last_not_of(" \t\r\n");
+				token(":");
+				space();
+				std::string_view type = annotation.substr(begin + 1, end - begin);
+				token(type.substr(type.find_first_not_of(" \t\r\n")));
+				skip_comments_before(type_end);
+			}
+		}
+		block(function->body, function->location.end);
+		token("end");
+		live_locals = saved_live;
+	}
+
+	// Statements
+	void block(Luau::AstStatBlock* node, Luau::Position end, bool keep_scope = false) {
+		size_t saved_live = live_locals;
+		if (node->body.size == 0 && !has_comments_before(end)) {
+			space();
+			return;
+		}
+		depth++;
+		block_start = true;
+		size_t previous_end = std::string::npos;
+		for (Luau::AstStat* stat : node->body) {
+			if (minify && (stat->is<Luau::AstStatTypeAlias>() || stat->is<Luau::AstStatDeclareGlobal>()
+				|| stat->is<Luau::AstStatDeclareFunction>() || stat->is<Luau::AstStatDeclareClass>())) {
+				continue;
+			}
+			comments_before(stat->location.begin);
+			begin_line(stat->location.begin.line);
+			size_t start = out.size();
+			statement(stat);
+			// A statement starting with `(` would otherwise continue the previous one as a call
+			if (previous_end != std::string::npos && start < out.size() && out[start] == '(') {
+				out.insert(previous_end, 1, ';');
+			}
+			previous_end = out.size();
+			last_line = stat->location.end.line;
+			trailing_comment(last_line);
+		}
+		comments_before(end);
+		depth--;
+		block_start = true;
+		begin_line(end.line);
+		if (!keep_scope) {
+			live_locals = saved_live;
+		}
+	}
+	void statement(Luau::AstStat* node) {
+		if (Luau::AstStatBlock* block_node = node->as<Luau::AstStatBlock>()) {
+			token("do");
+			block(block_node, node->location.end);
+			token("end");
+		} else if (Luau::AstStatIf* if_node = node->as<Luau::AstStatIf>()) {
+			token("if");
+			for (;;) {
+				space();
+				expr(if_node->condition, NO_OPERATOR);
+				space();
+				token("then");
+				block(if_node->thenbody, if_node->elseLocation ? if_node->elseLocation->begin : node->location.end);
+				Luau::AstStatIf* next = if_node->elsebody ? if_node->elsebody->as<Luau::AstStatIf>() : nullptr;
+				if (!next) {
+					break;
+				}
+				token("elseif");
+				if_node = next;
+			}
+			if (if_node->elsebody) {
+				token("else");
+				block(if_node->elsebody->as<Luau::AstStatBlock>(), node->location.end);
+			}
+			token("end");
+		} else if (Luau::AstStatWhile* while_node = node->as<Luau::AstStatWhile>()) {
+			token("while");
+			space();
+			expr(while_node->condition, NO_OPERATOR);
+			space();
+			token("do");
+			block(while_node->body, node->location.end);
+			token("end");
+		} else if (Luau::AstStatRepeat* repeat = node->as<Luau::AstStatRepeat>()) {
+			// The condition can see the body's locals
+			size_t saved_live = live_locals;
+			token("repeat");
+			block(repeat->body, repeat->condition->location.begin, true);
+			token("until");
+			space();
+			expr(repeat->condition, NO_OPERATOR);
+			live_locals = saved_live;
+		} else if (node->is<Luau::AstStatBreak>()) {
+			token("break");
+		} else if (node->is<Luau::AstStatContinue>()) {
+			token("continue");
+		} else if (Luau::AstStatReturn* return_node = node->as<Luau::AstStatReturn>()) {
+			token("return");
+			if (return_node->list.size) {
+				space();
+				list(return_node->list);
+			}
+		} else if (Luau::AstStatExpr* expression = node->as<Luau::AstStatExpr>()) {
+			expr(expression->expr, NO_OPERATOR);
+		} else if (Luau::AstStatLocal* local_node = node->as<Luau::AstStatLocal>()) {
+			// Values are printed before the new locals are live, since they can't see them
+			token("local");
+			space();
+			for (size_t i = 0; i < local_node->vars.size; i++) {
+				if (i) {
+					comma();
+				}
+				declare(local_node->vars.data[i], live_locals + i);
+				local_with_annotation(local_node->vars.data[i]);
+			}
+			if (local_node->values.size) {
+				space();
+				token("=");
+				space();
+				list(local_node->values);
+			}
+			live_locals += local_node->vars.size;
+		} else if (Luau::AstStatFor* for_node = node->as<Luau::AstStatFor>()) {
+			size_t saved_live = live_locals;
+			token("for");
+			space();
+			declare(for_node->var, live_locals);
+			local_with_annotation(for_node->var);
+			space();
+			token("=");
+			space();
+			expr(for_node->from, NO_OPERATOR);
+			comma();
+			expr(for_node->to, NO_OPERATOR);
+			if (for_node->step) {
+				comma();
+				expr(for_node->step, NO_OPERATOR);
+			}
+			space();
+			token("do");
+			live_locals++;
+			block(for_node->body, node->location.end);
+			token("end");
+			live_locals = saved_live;
+		} else if (Luau::AstStatForIn* for_in = node->as<Luau::AstStatForIn>()) {
+			size_t saved_live = live_locals;
+			token("for");
+			space();
+			for (size_t i = 0; i < for_in->vars.size; i++) {
+				if (i) {
+					comma();
+				}
+				declare(for_in->vars.data[i], live_locals + i);
+				local_with_annotation(for_in->vars.data[i]);
+			}
+			space();
+			token("in");
+			space();
+			list(for_in->values);
+			space();
+			token("do");
+			live_locals += for_in->vars.size;
+			block(for_in->body, node->location.end);
+			token("end");
+			live_locals = saved_live;
+		} else if (Luau::AstStatAssign* assign = node->as<Luau::AstStatAssign>()) {
+			list(assign->vars);
+			space();
+			token("=");
+			space();
+			list(assign->values);
+		} else if (Luau::AstStatCompoundAssign* compound = node->as<Luau::AstStatCompoundAssign>()) {
+			int left, right;
+			const char* text;
+			binary_priority(compound->op, left, right, text);
+			expr(compound->var, NO_OPERATOR);
+			space();
+			token(std::string(text) + "=");
+			space();
+			expr(compound->value, NO_OPERATOR);
+		} else if (Luau::AstStatFunction* function = node->as<Luau::AstStatFunction>()) {
+			attributes(function->func);
+			token("function");
+			space();
+			expr(function->name, NO_OPERATOR);
+			if (!minify && function->func->argLocation) {
+				generics(function->name->location.end, function->func->argLocation->begin);
+			}
+			function_body(function->func);
+		} else if (Luau::AstStatLocalFunction* local_function = node->as<Luau::AstStatLocalFunction>()) {
+			// The function can see its own name
+			attributes(local_function->func);
+			token("local");
+			space();
+			token("function");
+			space();
+			declare(local_function->name, live_locals++);
+			local(local_function->name);
+			if (!minify && local_function->func->argLocation) {
+				generics(local_function->name->location.end, local_function->func->argLocation->begin);
+			}
+			function_body(local_function->func);
+		} else {
+			// Type declarations and anything else that doesn't reach the bytecode
+			copy(node->location);
+		}
+	}
+
+	void root(const Luau::ParseResult& parsed) {
+		if (minify) {
+			global_name_visitor visitor(reserved);
+			parsed.root->visit(&visitor);
+			reserved.insert(std::begin(KEYWORDS), std::end(KEYWORDS));
+			reserved.insert(std::begin(RESERVED_LOCAL_NAMES), std::end(RESERVED_LOCAL_NAMES));
+			for (const Luau::HotComment& hotcomment : parsed.hotcomments) {
+				if (hotcomment.header) {
+					out += "--!";
+					out += hotcomment.content;
+					out += '\n';
+				}
+			}
+		} else {
+			comments = &parsed.commentLocations;
+		}
+		// The root block isn't indented
+		depth = -1;
+		Luau::Position end(static_cast<unsigned int>(line_offsets.size()), 0);
+		block(parsed.root, end);
+		while (!out.empty() && (out.back() == '\n' || out.back() == ' ' || out.back() == '\t')) {
+			out.pop_back();
+		}
+		if (!minify) {
+			out += '\n';
+		}
+	}
+};
+
+int print_source(lua_State* thread, bool minify) {
+	stack_slots_needed(2);
+	size_t length;
+	const char* source = luaL_checklstring(thread, 1, &length);
+	Luau::ParseOptions parse_options;
+	parse_options.captureComments = !minify;
+	ast_printer printer(std::string_view(source, length), minify);
+	if (lua_gettop(thread) >= 2 && !lua_isnil(thread, 2)) {
+		check_parse_options(thread, 2, parse_options);
+		parse_options.captureComments = !minify;
+		if (lua_getfield(thread, 2, "indent")) {
+			if (lua_type(thread, -1) == LUA_TNUMBER) {
+				printer.indent_unit = std::string(luaL_checkunsigned(thread, -1), ' ');
+			} else {
+				printer.indent_unit = luaL_checkstring(thread, -1);
+			}
+		}
+		lua_pop(thread, 1);
+		if (lua_getfield(thread, 2, "rename")) {
+			printer.rename = minify && luaL_checkboolean(thread, -1);
+		}
+		lua_pop(thread, 1);
+	}
+
+	Luau::Allocator allocator;
+	Luau::AstNameTable names(allocator);
+	Luau::ParseResult parsed = Luau::Parser::parse(source, length, names, allocator, parse_options);
+	if (!parsed.errors.empty()) {
+		const Luau::ParseError& error = parsed.errors.front();
+		lua_pushfstring(thread, "%d:%d: %s", error.getLocation().begin.line + 1, error.getLocation().begin.column + 1, error.getMessage().c_str());
+		lua_error(thread);
+		return 0;
+	}
+	printer.root(parsed);
+	lua_pushlstring(thread, printer.out.data(), printer.out.size());
+	return 1;
+}
+
+// format(source, {indent = "\t" | spaces, ...parse options}) -> source
+int format(lua_State* thread) {
+	wanted_arg_count(1);
+	return print_source(thread, false);
+}
+// minify(source, {rename = true, ...parse options}) -> source
+int minify(lua_State* thread) {
+	wanted_arg_count(1);
+	return print_source(thread, true);
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "luau.h"
+
+// format(source, options) -> source
+int format(lua_State* thread);
+// minify(source, options) -> source
+int minify(lua_State* thread);
\ No newline at end of file
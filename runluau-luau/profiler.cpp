@@ -0,0 +1,249 @@
+#include "pch.h"
+
+#include "profiler.h"
+
+// Sampling profiler. A timer thread counts ticks, and the VM interrupt (which Luau calls at
+// function calls and loop back edges) records the current coroutine's stack whenever ticks are
+// pending, weighted by how many ticks passed. Stacks are aggregated in a trie keyed by
+// (parent node, frame) so recording a sample is a few hash lookups and no allocations.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Frames are keyed by the strings' contents, since the strings behind `lua_Debug` can be collected and their
+// memory reused by a different function's. Lookups use views so a frame that was seen before allocates nothing.
+struct profiler_frame_view {
+	std::string_view source;
+	std::string_view name;
+	int line_defined;
+	bool operator==(const profiler_frame_view&) const = default;
+};
+struct profiler_frame_key {
+	std::string source;
+	std::string name;
+	int line_defined;
+	operator profiler_frame_view() const {
+		return {.source = source, .name = name, .line_defined = line_defined};
+	}
+};
+struct profiler_frame_key_hash {
+	using is_transparent = void;
+	size_t operator()(const profiler_frame_view& key) const {
+		size_t hash = std::hash<std::string_view>()(key.source);
+		hash ^= std::hash<std::string_view>()(key.name) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+		hash ^= std::hash<int>()(key.line_defined) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+		return hash;
+	}
+	size_t operator()(const profiler_frame_key& key) const {
+		return (*this)(static_cast<profiler_frame_view>(key));
+	}
+};
+struct profiler_frame_key_equal {
+	using is_transparent = void;
+	bool operator()(const profiler_frame_view& a, const profiler_frame_view& b) const {
+		return a == b;
+	}
+};
+struct profiler_node {
+	uint32_t parent;
+	uint32_t frame;
+	uint64_t samples; // Samples where this node was the innermost frame
+};
+struct profiler_state {
+	lua_State* main_thread;
+	void (*previous_interrupt)(lua_State* thread, int gc) = nullptr;
+	std::thread timer;
+	HANDLE timer_stop = CreateEventW(NULL, TRUE, FALSE, NULL);
+	std::atomic<uint32_t> pending_ticks = 0;
+	std::chrono::nanoseconds period;
+
+	std::vector<std::string> frame_names;
+	std::unordered_map<profiler_frame_key, uint32_t, profiler_frame_key_hash, profiler_frame_key_equal> frame_ids;
+	std::vector<profiler_node> nodes;
+	std::unordered_map<uint64_t, uint32_t> children; // (parent << 32 | frame) -> node
+	std::vector<uint32_t> stack; // Scratch space for the frames of the sample being recorded
+
+	~profiler_state() {
+		CloseHandle(timer_stop);
+	}
+};
+profiler_state* profiler = nullptr;
+constexpr const char* PROFILER_GUARD_KEY = "runluau-luau-profiler";
+
+uint32_t get_frame_id(const lua_Debug& info) {
+	profiler_frame_view view{.source = info.source ? info.source : "", .name = info.name ? info.name : "", .line_defined = info.linedefined};
+	auto it = profiler->frame_ids.find(view);
+	if (it == profiler->frame_ids.end()) {
+		profiler_frame_key key{.source = std::string(view.source), .name = std::string(view.name), .line_defined = view.line_defined};
+		it = profiler->frame_ids.emplace(std::move(key), static_cast<uint32_t>(profiler->frame_names.size())).first;
+		std::string name = info.name ? info.name : "anonymous";
+		name += " (";
+		name += info.short_src;
+		if (info.linedefined >= 0) {
+			name += ':';
+			name += std::to_string(info.linedefined);
+		}
+		name += ')';
+		// `;` separates frames in the folded format
+		std::replace(name.begin(), name.end(), ';', ',');
+		profiler->frame_names.push_back(std::move(name));
+	}
+	return it->second;
+}
+void record_sample(lua_State* thread, uint32_t weight) {
+	profiler->stack.clear();
+	lua_Debug info;
+	for (int level = 0; lua_getinfo(thread, level, "sn", &info); level++) {
+		profiler->stack.push_back(get_frame_id(info));
+	}
+	uint32_t node = 0;
+	for (auto frame = profiler->stack.rbegin(); frame != profiler->stack.rend(); ++frame) {
+		uint64_t key = (static_cast<uint64_t>(node) << 32) | *frame;
+		auto [it, inserted] = profiler->children.try_emplace(key, static_cast<uint32_t>(profiler->nodes.size()));
+		if (inserted) {
+			profiler->nodes.push_back({.parent = node, .frame = *frame, .samples = 0});
+		}
+		node = it->second;
+	}
+	profiler->nodes[node].samples += weight;
+}
+void profiler_interrupt(lua_State* thread, int gc) {
+	if (profiler->previous_interrupt) {
+		profiler->previous_interrupt(thread, gc);
+	}
+	if (gc >= 0 || profiler->pending_ticks.load(std::memory_order_relaxed) == 0) {
+		return;
+	}
+	uint32_t weight = profiler->pending_ticks.exchange(0, std::memory_order_relaxed);
+	if (weight) {
+		record_sample(thread, weight);
+	}
+}
+
+// Stops the timer and takes the interrupt back out
+void shutdown_profiler() {
+	SetEvent(profiler->timer_stop);
+	profiler->timer.join();
+	lua_callbacks(profiler->main_thread)->interrupt = profiler->previous_interrupt;
+}
+// Lives in the registry while profiling, so closing the VM without calling `profiler_stop` still shuts the profiler down
+void destroy_profiler_guard(void* ud) {
+	profiler_state* state = *static_cast<profiler_state**>(ud);
+	if (state && state == profiler) {
+		shutdown_profiler();
+		delete profiler;
+		profiler = nullptr;
+	}
+}
+
+// The default timer resolution is ~15.6 ms, far too coarse for sampling, so a high resolution timer is used where
+// the OS has one. Waiting for each deadline instead of a fixed delay keeps the rate steady.
+void profiler_timer(profiler_state* state) {
+	HANDLE timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!timer) {
+		timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+	}
+	if (!timer) {
+		return;
+	}
+	HANDLE waits[] = {state->timer_stop, timer};
+	auto next = std::chrono::steady_clock::now();
+	for (;;) {
+		next += state->period;
+		auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(next - std::chrono::steady_clock::now());
+		if (remaining.count() > 0) {
+			LARGE_INTEGER due_time = {.QuadPart = -static_cast<LONGLONG>(remaining.count() / 100)}; // Negative for relative, in 100 ns units
+			if (!SetWaitableTimerEx(timer, &due_time, 0, NULL, NULL, NULL, 0)) {
+				break;
+			}
+			if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+				break; // Stopped
+			}
+		} else if (WaitForSingleObject(state->timer_stop, 0) == WAIT_OBJECT_0) {
+			break;
+		}
+		state->pending_ticks.fetch_add(1, std::memory_order_relaxed);
+	}
+	CloseHandle(timer);
+}
+
+// profiler_start({frequency = 1000}) starts sampling every coroutine in the VM
+int profiler_start(lua_State* thread) {
+	stack_slots_needed(1);
+	if (profiler) {
+		lua_pushstring(thread, "Profiler is already running");
+		lua_error(thread);
+		return 0;
+	}
+	double frequency = 1000;
+	if (lua_gettop(thread) >= 1 && !lua_isnil(thread, 1)) {
+		luaL_checktype(thread, 1, LUA_TTABLE);
+		if (lua_getfield(thread, 1, "frequency")) {
+			frequency = luaL_checknumber(thread, -1);
+		}
+		lua_pop(thread, 1);
+		if (!(frequency > 0 && frequency <= 100000)) {
+			lua_pushstring(thread, "Profiler frequency must be between 0 and 100000 Hz");
+			lua_error(thread);
+			return 0;
+		}
+	}
+
+	profiler_state** guard = static_cast<profiler_state**>(lua_newuserdatadtor(thread, sizeof(profiler_state*), destroy_profiler_guard));
+	*guard = nullptr;
+	lua_setfield(thread, LUA_REGISTRYINDEX, PROFILER_GUARD_KEY);
+
+	profiler = new profiler_state();
+	profiler->main_thread = lua_mainthread(thread);
+	profiler->period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / frequency));
+	profiler->nodes.push_back({.parent = 0, .frame = 0, .samples = 0}); // Root
+	lua_Callbacks* callbacks = lua_callbacks(thread);
+	profiler->previous_interrupt = callbacks->interrupt;
+	callbacks->interrupt = profiler_interrupt;
+	profiler->timer = std::thread(profiler_timer, profiler);
+	*guard = profiler;
+	return 0;
+}
+
+// Stops sampling and returns the samples in the folded stack format flamegraph tools read
+int profiler_stop(lua_State* thread) {
+	stack_slots_needed(1);
+	if (!profiler) {
+		lua_pushstring(thread, "Profiler is not running");
+		lua_error(thread);
+		return 0;
+	}
+	shutdown_profiler();
+	lua_getfield(thread, LUA_REGISTRYINDEX, PROFILER_GUARD_KEY);
+	*static_cast<profiler_state**>(lua_touserdata(thread, -1)) = nullptr; // Already shut down, so collecting it does nothing
+	lua_pop(thread, 1);
+	lua_pushnil(thread);
+	lua_setfield(thread, LUA_REGISTRYINDEX, PROFILER_GUARD_KEY);
+
+	std::string output;
+	std::vector<uint32_t> path;
+	for (uint32_t i = 1; i < profiler->nodes.size(); i++) {
+		const profiler_node& node = profiler->nodes[i];
+		if (node.samples == 0) {
+			continue;
+		}
+		path.clear();
+		for (uint32_t current = i; current != 0; current = profiler->nodes[current].parent) {
+			path.push_back(profiler->nodes[current].frame);
+		}
+		for (auto frame = path.rbegin(); frame != path.rend(); ++frame) {
+			if (frame != path.rbegin()) {
+				output += ';';
+			}
+			output += profiler->frame_names[*frame];
+		}
+		output += ' ';
+		output += std::to_string(node.samples);
+		output += '\n';
+	}
+	delete profiler;
+	profiler = nullptr;
+
+	lua_pushlstring(thread, output.data(), output.size());
+	return 1;
+}
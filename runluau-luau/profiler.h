@@ -0,0 +1,6 @@
+#pragma once
+
+#include "luau.h"
+
+int profiler_start(lua_State* thread);
+int profiler_stop(lua_State* thread);
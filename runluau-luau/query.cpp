@@ -0,0 +1,475 @@
+#include "pch.h"
+
+#include "query.h"
+#include "util.h"
+
+// Selectors for `query`, matched against the AST without pushing any of it to Lua.
+//
+//   selector   := compound (combinator compound)* ("," selector)*
+//   combinator := whitespace (descendant) | ">" (child)
+//   compound   := (kind | "*")? ("#" name)? ("[" attribute (operator value)? "]")*
+//
+// Kinds are Luau's node class names, with or without the `Ast` prefix, or `Expr`, `Stat` and `Type`
+// for any node of that category. `#name` is short for `[name=name]`. Operators are `=`, `~=`, `^=`
+// (prefix), `$=` (suffix) and `*=` (contains), and a bare `[attribute]` only checks that the node has
+// the attribute. Values are bare words or quoted strings.
+//
+// Attributes:
+//   name   - the identifier a node is about: global/local name, indexed field, called or declared function name
+//   path   - dotted path of a name or index chain, like `game.Workspace.Part`, and of what a call calls
+//   value  - constant value
+//   args   - argument count of calls and functions
+//   method - "true" for `a:b()` calls and functions with `self`
+//   op     - operator of unary, binary and compound assignment nodes
+#define NODE_KINDS(X) \
+	X(AstExprGroup) X(AstExprConstantNil) X(AstExprConstantBool) X(AstExprConstantNumber) X(AstExprConstantString) \
+	X(AstExprLocal) X(AstExprGlobal) X(AstExprVarargs) X(AstExprCall) X(AstExprIndexName) X(AstExprIndexExpr) \
+	X(AstExprFunction) X(AstExprTable) X(AstExprUnary) X(AstExprBinary) X(AstExprTypeAssertion) X(AstExprIfElse) \
+	X(AstExprInterpString) X(AstExprError) \
+	X(AstStatBlock) X(AstStatIf) X(AstStatWhile) X(AstStatRepeat) X(AstStatBreak) X(AstStatContinue) X(AstStatReturn) \
+	X(AstStatExpr) X(AstStatLocal) X(AstStatFor) X(AstStatForIn) X(AstStatAssign) X(AstStatCompoundAssign) \
+	X(AstStatFunction) X(AstStatLocalFunction) X(AstStatTypeAlias) X(AstStatDeclareFunction) X(AstStatDeclareGlobal) \
+	X(AstStatDeclareClass) X(AstStatError) \
+	X(AstTypeReference) X(AstTypeTable) X(AstTypeFunction) X(AstTypeTypeof) X(AstTypeUnion) X(AstTypeIntersection) \
+	X(AstTypeSingletonBool) X(AstTypeSingletonString) X(AstTypeError) \
+	X(AstTypePackExplicit) X(AstTypePackVariadic) X(AstTypePackGeneric)
+
+constexpr int ANY_KIND = -1;
+constexpr int ANY_EXPR = -2;
+constexpr int ANY_STAT = -3;
+constexpr int ANY_TYPE = -4;
+constexpr int UNKNOWN_KIND = -5;
+
+int node_kind(std::string_view name) {
+	#define KIND_ENTRY(type) {#type, Luau::type::ClassIndex()},
+	static const std::pair<std::string_view, int> kinds[] = {NODE_KINDS(KIND_ENTRY)};
+	#undef KIND_ENTRY
+	if (name == "Expr") {
+		return ANY_EXPR;
+	} else if (name == "Stat") {
+		return ANY_STAT;
+	} else if (name == "Type") {
+		return ANY_TYPE;
+	}
+	for (const auto& [kind_name, index] : kinds) {
+		if (kind_name == name || kind_name.substr(3) == name) {
+			return index;
+		}
+	}
+	return UNKNOWN_KIND;
+}
+
+enum class query_operator {
+	exists,
+	equal,
+	not_equal,
+	prefix,
+	suffix,
+	contains,
+};
+struct query_predicate {
+	std::string attribute;
+	query_operator op = query_operator::exists;
+	std::string value;
+};
+struct query_compound {
+	int kind = ANY_KIND;
+	std::vector<query_predicate> predicates;
+	bool child = false; // Combinator to the compound before this one
+};
+using query_selector = std::vector<query_compound>;
+
+struct selector_parser {
+	std::string_view text;
+	size_t position = 0;
+	std::string error;
+
+	bool at_end() const {
+		return position >= text.size();
+	}
+	void skip_whitespace() {
+		while (!at_end() && isspace(static_cast<unsigned char>(text[position]))) {
+			position++;
+		}
+	}
+	std::string_view word() {
+		size_t start = position;
+		while (!at_end() && (isalnum(static_cast<unsigned char>(text[position])) || text[position] == '_')) {
+			position++;
+		}
+		return text.substr(start, position - start);
+	}
+	bool value(std::string& out) {
+		if (!at_end() && (text[position] == '"' || text[position] == '\'')) {
+			char quote = text[position++];
+			while (!at_end() && text[position] != quote) {
+				if (text[position] == '\\' && position + 1 < text.size()) {
+					position++;
+				}
+				out += text[position++];
+			}
+			if (at_end()) {
+				error = "unterminated string";
+				return false;
+			}
+			position++;
+			return true;
+		}
+		size_t start = position;
+		while (!at_end() && text[position] != ']' && !isspace(static_cast<unsigned char>(text[position]))) {
+			position++;
+		}
+		out = text.substr(start, position - start);
+		return true;
+	}
+	bool compound(query_compound& out) {
+		if (!at_end() && text[position] == '*') {
+			position++;
+		} else if (std::string_view kind = word(); !kind.empty()) {
+			out.kind = node_kind(kind);
+			if (out.kind == UNKNOWN_KIND) {
+				error = "unknown node kind \"" + std::string(kind) + "\"";
+				return false;
+			}
+		}
+		if (!at_end() && text[position] == '#') {
+			position++;
+			std::string_view name = word();
+			if (name.empty()) {
+				error = "expected a name after '#'";
+				return false;
+			}
+			out.predicates.push_back({.attribute = "name", .op = query_operator::equal, .value = std::string(name)});
+		}
+		while (!at_end() && text[position] == '[') {
+			position++;
+			skip_whitespace();
+			query_predicate predicate;
+			predicate.attribute = word();
+			if (predicate.attribute.empty()) {
+				error = "expected an attribute name";
+				return false;
+			}
+			skip_whitespace();
+			std::string_view rest = text.substr(position);
+			if (rest.starts_with("=")) {
+				predicate.op = query_operator::equal, position += 1;
+			} else if (rest.starts_with("~=") || rest.starts_with("!=")) {
+				predicate.op = query_operator::not_equal, position += 2;
+			} else if (rest.starts_with("^=")) {
+				predicate.op = query_operator::prefix, position += 2;
+			} else if (rest.starts_with("$=")) {
+				predicate.op = query_operator::suffix, position += 2;
+			} else if (rest.starts_with("*=")) {
+				predicate.op = query_operator::contains, position += 2;
+			}
+			if (predicate.op != query_operator::exists) {
+				skip_whitespace();
+				if (!value(predicate.value)) {
+					return false;
+				}
+				skip_whitespace();
+			}
+			if (at_end() || text[position] != ']') {
+				error = "expected ']'";
+				return false;
+			}
+			position++;
+			out.predicates.push_back(std::move(predicate));
+		}
+		return true;
+	}
+	bool parse(std::vector<query_selector>& selectors) {
+		selectors.emplace_back();
+		bool child = false;
+		skip_whitespace();
+		for (;;) {
+			size_t start = position;
+			query_compound current;
+			if (!compound(current)) {
+				return false;
+			}
+			if (position == start) {
+				error = "expected a selector";
+				return false;
+			}
+			current.child = child;
+			child = false;
+			selectors.back().push_back(std::move(current));
+
+			size_t before_whitespace = position;
+			skip_whitespace();
+			if (at_end()) {
+				return true;
+			} else if (text[position] == ',') {
+				position++;
+				skip_whitespace();
+				selectors.emplace_back();
+			} else if (text[position] == '>') {
+				position++;
+				skip_whitespace();
+				child = true;
+			} else if (position == before_whitespace) {
+				error = std::string("unexpected '") + text[position] + "'";
+				return false;
+			}
+		}
+	}
+};
+
+// Dotted path of a name or index chain, or false if the expression isn't one
+bool expression_path(Luau::AstExpr* expression, std::string& out) {
+	if (Luau::AstExprGlobal* global = expression->as<Luau::AstExprGlobal>()) {
+		out = global->name.value;
+		return true;
+	} else if (Luau::AstExprLocal* local = expression->as<Luau::AstExprLocal>()) {
+		out = local->local->name.value;
+		return true;
+	} else if (Luau::AstExprIndexName* index = expression->as<Luau::AstExprIndexName>()) {
+		if (!expression_path(index->expr, out)) {
+			return false;
+		}
+		out += '.';
+		out += index->index.value;
+		return true;
+	} else if (Luau::AstExprIndexExpr* index = expression->as<Luau::AstExprIndexExpr>()) {
+		Luau::AstExprConstantString* key = index->index->as<Luau::AstExprConstantString>();
+		if (!key || !expression_path(index->expr, out)) {
+			return false;
+		}
+		out += '.';
+		out.append(key->value.data, key->value.size);
+		return true;
+	} else if (Luau::AstExprGroup* group = expression->as<Luau::AstExprGroup>()) {
+		return expression_path(group->expr, out);
+	}
+	return false;
+}
+bool expression_name(Luau::AstExpr* expression, std::string& out) {
+	if (Luau::AstExprGlobal* global = expression->as<Luau::AstExprGlobal>()) {
+		out = global->name.value;
+	} else if (Luau::AstExprLocal* local = expression->as<Luau::AstExprLocal>()) {
+		out = local->local->name.value;
+	} else if (Luau::AstExprIndexName* index = expression->as<Luau::AstExprIndexName>()) {
+		out = index->index.value;
+	} else if (Luau::AstExprIndexExpr* index = expression->as<Luau::AstExprIndexExpr>()) {
+		Luau::AstExprConstantString* key = index->index->as<Luau::AstExprConstantString>();
+		if (!key) {
+			return false;
+		}
+		out.assign(key->value.data, key->value.size);
+	} else {
+		return false;
+	}
+	return true;
+}
+std::string number_string(double number) {
+	char buffer[32];
+	for (int precision = 15; precision <= 17; precision++) {
+		snprintf(buffer, sizeof(buffer), "%.*g", precision, number);
+		if (strtod(buffer, nullptr) == number) {
+			break;
+		}
+	}
+	return buffer;
+}
+
+// Returns false if the node doesn't have the attribute
+bool node_attribute(Luau::AstNode* node, std::string_view attribute, std::string& out) {
+	if (attribute == "name") {
+		if (Luau::AstExprCall* call = node->as<Luau::AstExprCall>()) {
+			return expression_name(call->func, out);
+		} else if (Luau::AstStatFunction* function = node->as<Luau::AstStatFunction>()) {
+			return expression_name(function->name, out);
+		} else if (Luau::AstStatLocalFunction* function = node->as<Luau::AstStatLocalFunction>()) {
+			out = function->name->name.value;
+			return true;
+		} else if (Luau::AstExprFunction* function = node->as<Luau::AstExprFunction>()) {
+			if (!function->debugname.value) {
+				return false;
+			}
+			out = function->debugname.value;
+			return true;
+		} else if (Luau::AstStatTypeAlias* alias = node->as<Luau::AstStatTypeAlias>()) {
+			out = alias->name.value;
+			return true;
+		} else if (Luau::AstTypeReference* reference = node->as<Luau::AstTypeReference>()) {
+			out = reference->name.value;
+			return true;
+		} else if (Luau::AstExpr* expression = node->asExpr()) {
+			return expression_name(expression, out);
+		}
+	} else if (attribute == "path") {
+		if (Luau::AstExprCall* call = node->as<Luau::AstExprCall>()) {
+			return expression_path(call->func, out);
+		} else if (Luau::AstStatFunction* function = node->as<Luau::AstStatFunction>()) {
+			return expression_path(function->name, out);
+		} else if (Luau::AstExpr* expression = node->asExpr()) {
+			return expression_path(expression, out);
+		}
+	} else if (attribute == "value") {
+		if (Luau::AstExprConstantString* string = node->as<Luau::AstExprConstantString>()) {
+			out.assign(string->value.data, string->value.size);
+			return true;
+		} else if (Luau::AstExprConstantNumber* number = node->as<Luau::AstExprConstantNumber>()) {
+			out = number_string(number->value);
+			return true;
+		} else if (Luau::AstExprConstantBool* boolean = node->as<Luau::AstExprConstantBool>()) {
+			out = boolean->value ? "true" : "false";
+			return true;
+		} else if (node->is<Luau::AstExprConstantNil>()) {
+			out = "nil";
+			return true;
+		}
+	} else if (attribute == "args") {
+		if (Luau::AstExprCall* call = node->as<Luau::AstExprCall>()) {
+			out = std::to_string(call->args.size);
+			return true;
+		} else if (Luau::AstExprFunction* function = node->as<Luau::AstExprFunction>()) {
+			out = std::to_string(function->args.size);
+			return true;
+		}
+	} else if (attribute == "method") {
+		if (Luau::AstExprCall* call = node->as<Luau::AstExprCall>()) {
+			out = call->self ? "true" : "false";
+			return true;
+		} else if (Luau::AstExprFunction* function = node->as<Luau::AstExprFunction>()) {
+			out = function->self ? "true" : "false";
+			return true;
+		}
+	} else if (attribute == "op") {
+		if (Luau::AstExprBinary* binary = node->as<Luau::AstExprBinary>()) {
+			out = Luau::toString(binary->op);
+			return true;
+		} else if (Luau::AstStatCompoundAssign* assign = node->as<Luau::AstStatCompoundAssign>()) {
+			out = Luau::toString(assign->op);
+			return true;
+		} else if (Luau::AstExprUnary* unary = node->as<Luau::AstExprUnary>()) {
+			switch (unary->op) {
+			case Luau::AstExprUnary::Not: out = "not"; break;
+			case Luau::AstExprUnary::Minus: out = "-"; break;
+			case Luau::AstExprUnary::Len: out = "#"; break;
+			default: return false;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+bool compound_matches(const query_compound& compound, Luau::AstNode* node) {
+	switch (compound.kind) {
+	case ANY_KIND: break;
+	case ANY_EXPR: if (!node->asExpr()) return false; break;
+	case ANY_STAT: if (!node->asStat()) return false; break;
+	case ANY_TYPE: if (!node->asType()) return false; break;
+	default: if (node->classIndex != compound.kind) return false; break;
+	}
+	std::string value;
+	for (const query_predicate& predicate : compound.predicates) {
+		value.clear();
+		if (!node_attribute(node, predicate.attribute, value)) {
+			return false;
+		}
+		bool matched = true;
+		switch (predicate.op) {
+		case query_operator::exists: break;
+		case query_operator::equal: matched = value == predicate.value; break;
+		case query_operator::not_equal: matched = value != predicate.value; break;
+		case query_operator::prefix: matched = value.starts_with(predicate.value); break;
+		case query_operator::suffix: matched = value.ends_with(predicate.value); break;
+		case query_operator::contains: matched = value.find(predicate.value) != std::string::npos; break;
+		}
+		if (!matched) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Keeps the path from the root to the current node so combinators can be checked right to left
+struct query_visitor : Luau::AstVisitor {
+	const std::vector<query_selector>& selectors;
+	std::vector<Luau::AstNode*> ancestors;
+	std::vector<Luau::Location> matches;
+	Luau::AstNode* entered = nullptr;
+
+	query_visitor(const std::vector<query_selector>& selectors) : selectors(selectors) {}
+
+	// Whether selector[0..step) matches above ancestors[0..above), given selector[step] matched below them
+	bool ancestors_match(const query_selector& selector, size_t step, size_t above) const {
+		if (step == 0) {
+			return true;
+		}
+		if (selector[step].child) {
+			return above > 0 && compound_matches(selector[step - 1], ancestors[above - 1]) && ancestors_match(selector, step - 1, above - 1);
+		}
+		for (size_t i = above; i-- > 0;) {
+			if (compound_matches(selector[step - 1], ancestors[i]) && ancestors_match(selector, step - 1, i)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	bool visit(Luau::AstNode* node) override {
+		if (node == entered) {
+			return true; // Called back from node->visit below, so let it visit its children
+		}
+		for (const query_selector& selector : selectors) {
+			if (compound_matches(selector.back(), node) && ancestors_match(selector, selector.size() - 1, ancestors.size())) {
+				matches.push_back(node->location);
+				break;
+			}
+		}
+		ancestors.push_back(node);
+		Luau::AstNode* parent = entered;
+		entered = node;
+		node->visit(this);
+		entered = parent;
+		ancestors.pop_back();
+		return false;
+	}
+	bool visit(Luau::AstType* node) override {
+		return visit(static_cast<Luau::AstNode*>(node));
+	}
+	bool visit(Luau::AstTypePack* node) override {
+		return visit(static_cast<Luau::AstNode*>(node));
+	}
+};
+
+// query(source, selector, options) -> {location}
+int query(lua_State* thread) {
+	wanted_arg_count(2);
+	stack_slots_needed(3);
+	size_t length;
+	const char* source = luaL_checklstring(thread, 1, &length);
+	size_t selector_length;
+	const char* selector = luaL_checklstring(thread, 2, &selector_length);
+	Luau::ParseOptions options;
+	if (lua_gettop(thread) >= 3 && !lua_isnil(thread, 3)) {
+		check_parse_options(thread, 3, options);
+	}
+
+	selector_parser parser{.text = std::string_view(selector, selector_length)};
+	std::vector<query_selector> selectors;
+	if (!parser.parse(selectors)) {
+		lua_pushfstring(thread, "Invalid selector at character %d: %s", static_cast<int>(parser.position + 1), parser.error.c_str());
+		lua_error(thread);
+		return 0;
+	}
+
+	Luau::Allocator allocator;
+	Luau::AstNameTable names(allocator);
+	Luau::ParseResult parsed = Luau::Parser::parse(source, length, names, allocator, options);
+	query_visitor visitor(selectors);
+	if (parsed.root) {
+		visitor.visit(static_cast<Luau::AstNode*>(parsed.root));
+	}
+
+	lua_createtable(thread, static_cast<int>(visitor.matches.size()), 0);
+	for (size_t i = 0; i < visitor.matches.size(); i++) {
+		push_location(thread, visitor.matches[i]);
+		lua_rawseti(thread, -2, static_cast<int>(i + 1));
+	}
+	return 1;
+}
\ No newline at end of file
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "luau.h"
+
+// query(source, selector, options) -> {location}
+int query(lua_State* thread);
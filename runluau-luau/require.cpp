@@ -0,0 +1,285 @@
+#include "pch.h"
+
+#include "coverage.h"
+#include "require.h"
+#include "util.h"
+
+// Module loader with a bytecode cache. Compiled bytecode is stored next to the source as
+// `<file>.bytecode` behind a header recording the source's mtime, size and hash and a hash of the
+// compile options. A matching mtime and size is trusted without reading the source, so a warm
+// start maps the cache file and hands it straight to luau_load. If only the mtime changed (a
+// checkout touching files), the source hash still lets the bytecode be reused.
+constexpr char REQUIRE_CACHE_MAGIC[4] = {'R', 'L', 'B', 'C'};
+constexpr uint32_t REQUIRE_CACHE_FORMAT = 1;
+constexpr const char* REQUIRE_CACHE_SUFFIX = ".bytecode";
+
+struct require_cache_header {
+	char magic[4];
+	uint32_t format;
+	int64_t mtime;
+	uint64_t size;
+	uint64_t source_hash;
+	uint64_t options_hash;
+};
+
+struct require_loader {
+	compile_options options;
+	uint64_t options_hash = 0;
+	bool cache = true;
+};
+
+// FNV-1a, which is stable across runs and builds unlike std::hash
+uint64_t hash_bytes(std::string_view bytes, uint64_t hash = 14695981039346656037ull) {
+	for (unsigned char byte : bytes) {
+		hash ^= byte;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+uint64_t hash_compile_options(const compile_options& options) {
+	const Luau::CompileOptions& o = options.options;
+	std::string key = std::to_string(LBC_VERSION_TARGET);
+	for (int level : {o.optimizationLevel, o.debugLevel, o.typeInfoLevel, o.coverageLevel}) {
+		key += ',';
+		key += std::to_string(level);
+	}
+	// Separators are NUL so no two different options serialize the same
+	for (const std::string* string : {&options.vector_lib, &options.vector_ctor, &options.vector_type}) {
+		key += '\0';
+		key += *string;
+	}
+	for (const std::vector<std::string>* list : {&options.mutable_globals, &options.userdata_types, &options.disabled_builtins}) {
+		key += '\1';
+		for (const std::string& string : *list) {
+			key += '\0';
+			key += string;
+		}
+	}
+	return hash_bytes(key);
+}
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope
+struct mapped_file {
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+	const char* view = nullptr;
+	size_t size = 0;
+
+	mapped_file(const std::filesystem::path& path) {
+		file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return;
+		}
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+			return; // CreateFileMapping refuses empty files
+		}
+		mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping) {
+			return;
+		}
+		view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (view) {
+			size = static_cast<size_t>(file_size.QuadPart);
+		}
+	}
+	~mapped_file() {
+		if (view) {
+			UnmapViewOfFile(view);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+	}
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	const require_cache_header* header() const {
+		if (size < sizeof(require_cache_header) || memcmp(view, REQUIRE_CACHE_MAGIC, sizeof(REQUIRE_CACHE_MAGIC)) != 0) {
+			return nullptr;
+		}
+		const require_cache_header* header = reinterpret_cast<const require_cache_header*>(view);
+		return header->format == REQUIRE_CACHE_FORMAT ? header : nullptr;
+	}
+	std::string_view bytecode() const {
+		return std::string_view(view + sizeof(require_cache_header), size - sizeof(require_cache_header));
+	}
+};
+
+// Writes to a temporary file first so a process starting up concurrently never maps half a cache
+void write_require_cache(const std::filesystem::path& path, const require_cache_header& header, std::string_view bytecode) {
+	std::filesystem::path temporary = path;
+	temporary += ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(bytecode.data(), bytecode.size());
+		if (!file) {
+			file.close();
+			std::error_code error;
+			std::filesystem::remove(temporary, error);
+			return;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error) {
+		std::filesystem::remove(temporary, error);
+	}
+}
+
+// Pushes the module's chunk, or an error message and returns false
+bool load_module(lua_State* thread, const require_loader& loader, const std::string& name, const std::filesystem::path& path) {
+	std::string chunk_name = "@" + name;
+	std::error_code error;
+	std::filesystem::file_time_type mtime = std::filesystem::last_write_time(path, error);
+	uint64_t size = error ? 0 : std::filesystem::file_size(path, error);
+	if (error) {
+		lua_pushfstring(thread, "Failed to read module %s: %s", name.c_str(), error.message().c_str());
+		return false;
+	}
+	require_cache_header header{
+		.format = REQUIRE_CACHE_FORMAT,
+		.mtime = mtime.time_since_epoch().count(),
+		.size = size,
+		.source_hash = 0,
+		.options_hash = loader.options_hash,
+	};
+	memcpy(header.magic, REQUIRE_CACHE_MAGIC, sizeof(REQUIRE_CACHE_MAGIC));
+
+	std::filesystem::path cache_path = path;
+	cache_path += REQUIRE_CACHE_SUFFIX;
+	std::optional<mapped_file> cache;
+	const require_cache_header* cached = nullptr;
+	if (loader.cache) {
+		cache.emplace(cache_path);
+		cached = cache->header();
+		if (cached && cached->options_hash != header.options_hash) {
+			cached = nullptr;
+		}
+		if (cached && cached->mtime == header.mtime && cached->size == header.size) {
+			std::string_view bytecode = cache->bytecode();
+			if (luau_load(thread, chunk_name.c_str(), bytecode.data(), bytecode.size(), 0) == 0) {
+				return true;
+			}
+			lua_pop(thread, 1); // Stale bytecode version, fall through to recompiling
+			cached = nullptr;
+		}
+	}
+
+	std::ifstream file(path, std::ios::binary);
+	std::string source(static_cast<size_t>(size), '\0');
+	if (!file.read(source.data(), source.size())) {
+		lua_pushfstring(thread, "Failed to read module %s", name.c_str());
+		return false;
+	}
+	header.source_hash = hash_bytes(source);
+
+	std::string bytecode;
+	if (cached && cached->source_hash == header.source_hash) {
+		bytecode = cache->bytecode();
+	} else {
+		bytecode = Luau::compile(source, loader.options.options, {});
+	}
+	cache.reset();
+	if (luau_load(thread, chunk_name.c_str(), bytecode.data(), bytecode.size(), 0) != 0) {
+		return false; // Compile errors come out of luau_load too
+	}
+	if (loader.cache) {
+		write_require_cache(cache_path, header, bytecode);
+	}
+	return true;
+}
+
+// `require("x")` resolves relative to the requiring module like `check` does, trying `x`, `x.luau`, `x.lua` and `x/init.luau`.
+// The module body runs inside this C function, and Luau can't resume a C function partway through a call, so a
+// module can't yield at its top level (like waiting on a task). Yielding there errors; functions it returns can still yield.
+int loader_require(lua_State* thread) {
+	wanted_arg_count(1);
+	stack_slots_needed(3);
+	require_loader* loader = static_cast<require_loader*>(lua_touserdata(thread, lua_upvalueindex(1)));
+	std::filesystem::path base(luau::checkstring(thread, 1));
+	lua_Debug info;
+	if (lua_getinfo(thread, 1, "s", &info) && info.source[0] == '@') {
+		base = std::filesystem::path(info.source + 1).parent_path() / base;
+	}
+	std::string stem = base.lexically_normal().generic_string();
+
+	std::string name;
+	std::filesystem::path path;
+	for (const char* suffix : MODULE_SUFFIXES) {
+		std::filesystem::path candidate(stem + suffix);
+		std::error_code error;
+		if (resolve_sandbox_path(candidate) && std::filesystem::is_regular_file(candidate, error)) {
+			name = stem + suffix;
+			path = std::move(candidate);
+			break;
+		}
+	}
+	if (name.empty()) {
+		lua_pushfstring(thread, "Module %s not found", stem.c_str());
+		lua_error(thread);
+		return 0;
+	}
+
+	lua_getfield(thread, lua_upvalueindex(2), name.c_str());
+	if (lua_islightuserdata(thread, -1)) {
+		lua_pushfstring(thread, "Cyclic require of %s", name.c_str());
+		lua_error(thread);
+		return 0;
+	} else if (!lua_isnil(thread, -1)) {
+		return 1;
+	}
+	lua_pop(thread, 1);
+
+	if (!load_module(thread, *loader, name, path)) {
+		lua_error(thread); // load_module left the error message on the stack
+		return 0;
+	}
+	coverage_loaded(thread, -1);
+	// Marks the module as loading so a cycle errors instead of recursing forever
+	lua_pushlightuserdata(thread, loader);
+	lua_setfield(thread, lua_upvalueindex(2), name.c_str());
+	if (lua_pcall(thread, 0, 1, 0) != 0) {
+		// Forget the module so requiring it again retries instead of reporting a cycle
+		lua_pushnil(thread);
+		lua_setfield(thread, lua_upvalueindex(2), name.c_str());
+		lua_error(thread);
+		return 0;
+	}
+	if (lua_isnil(thread, -1)) {
+		lua_pop(thread, 1);
+		lua_pushboolean(thread, true);
+	}
+	lua_pushvalue(thread, -1);
+	lua_setfield(thread, lua_upvalueindex(2), name.c_str());
+	return 1;
+}
+
+// loader(options) -> require
+// Options are the `compile` options plus `cache`, which can be set to false to never touch the disk cache.
+// Modules loaded through it must not yield at their top level, see loader_require.
+// Each loader has its own module table, so modules are shared by everything using the same `require`.
+int loader(lua_State* thread) {
+	stack_slots_needed(3);
+	bool has_options = !lua_isnoneornil(thread, 1);
+	void* memory = lua_newuserdatadtor(thread, sizeof(require_loader), destroy_userdata<require_loader>);
+	require_loader* loader = new (memory) require_loader();
+	if (has_options) {
+		check_compile_options(thread, 1, loader->options);
+		if (lua_getfield(thread, 1, "cache")) {
+			loader->cache = luaL_checkboolean(thread, -1);
+		}
+		lua_pop(thread, 1);
+	}
+	loader->options_hash = hash_compile_options(loader->options);
+	lua_newtable(thread);
+	lua_pushcclosure(thread, loader_require, "require", 2);
+	return 1;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "luau.h"
+
+// loader(options) -> require
+int loader(lua_State* thread);
@@ -0,0 +1,127 @@
+#include "pch.h"
+
+#include "util.h"
+
+bool resolve_sandbox_path(std::filesystem::path& path) {
+	return resolve_sandbox_path(path, luau::is_plugin_loaded("runluau-osunsafe.dll"));
+}
+bool resolve_sandbox_path(std::filesystem::path& path, bool unsafe) {
+	if (unsafe) {
+		return true;
+	}
+	// `\Windows` and `C:foo` aren't absolute but still carry a root, so strip anything rooted
+	std::filesystem::path relative = path.has_root_path() ? path.relative_path() : path;
+	relative = relative.lexically_normal();
+	for (const auto& part : relative) {
+		if (part == "..") {
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::path root = std::filesystem::weakly_canonical(std::filesystem::current_path() / "runluau-filesystem", error);
+	if (error) {
+		return false;
+	}
+	path = (root / relative).lexically_normal();
+	const auto& root_string = root.native();
+	const auto& path_string = path.native();
+	if (path_string.compare(0, root_string.size(), root_string) != 0) {
+		return false;
+	}
+	return path_string.size() == root_string.size() || path_string[root_string.size()] == L'\\' || path_string[root_string.size()] == L'/';
+}
+
+void run_parallel(size_t count, const std::function<void(size_t)>& task) {
+	std::atomic<size_t> next = 0;
+	auto worker = [&] {
+		for (size_t index; (index = next++) < count;) {
+			task(index);
+		}
+	};
+	size_t thread_count = std::thread::hardware_concurrency();
+	if (thread_count == 0) {
+		thread_count = 1;
+	}
+	if (thread_count > count) {
+		thread_count = count;
+	}
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < thread_count; i++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& other : workers) {
+		other.join();
+	}
+}
+
+void check_parse_options(lua_State* thread, int arg, Luau::ParseOptions& options) {
+	luaL_checktype(thread, arg, LUA_TTABLE);
+	if (lua_getfield(thread, arg, "allowDeclarationSyntax")) {
+		options.allowDeclarationSyntax = luaL_checkboolean(thread, -1);
+	}
+	lua_pop(thread, 1);
+	if (lua_getfield(thread, arg, "captureComments")) {
+		options.captureComments = luaL_checkboolean(thread, -1);
+	}
+	lua_pop(thread, 1);
+}
+
+void check_compile_level(lua_State* thread, int arg, const char* field, int max, int& out) {
+	if (lua_getfield(thread, arg, field)) {
+		unsigned int value = luaL_checkunsigned(thread, -1);
+		if (value > static_cast<unsigned int>(max)) {
+			lua_pushfstring(thread, "When compiling, %s must be an integer from 0 to %d", field, max);
+			lua_error(thread);
+		}
+		out = value;
+	}
+	lua_pop(thread, 1);
+}
+void check_compile_string(lua_State* thread, int arg, const char* field, std::string& out, const char*& option) {
+	if (lua_getfield(thread, arg, field)) {
+		out = luaL_checkstring(thread, -1);
+		option = out.c_str();
+	}
+	lua_pop(thread, 1);
+}
+void check_compile_list(lua_State* thread, int arg, const char* field, std::vector<std::string>& out, std::vector<const char*>& list, const char* const*& option) {
+	if (lua_getfield(thread, arg, field)) {
+		luaL_checktype(thread, -1, LUA_TTABLE);
+		int count = lua_objlen(thread, -1);
+		out.clear();
+		out.reserve(count);
+		for (int i = 1; i <= count; i++) {
+			lua_rawgeti(thread, -1, i);
+			if (lua_type(thread, -1) != LUA_TSTRING) {
+				lua_pushfstring(thread, "When compiling, %s must be an array of strings", field);
+				lua_error(thread);
+			}
+			size_t length;
+			const char* string = lua_tolstring(thread, -1, &length);
+			out.emplace_back(string, length);
+			lua_pop(thread, 1);
+		}
+		list.clear();
+		for (const std::string& string : out) {
+			list.push_back(string.c_str());
+		}
+		list.push_back(nullptr);
+		option = list.data();
+	}
+	lua_pop(thread, 1);
+}
+void check_compile_options(lua_State* thread, int arg, compile_options& options) {
+	stack_slots_needed(2);
+	luaL_checktype(thread, arg, LUA_TTABLE);
+	check_compile_level(thread, arg, "optimizationLevel", 2, options.options.optimizationLevel);
+	check_compile_level(thread, arg, "debugLevel", 2, options.options.debugLevel);
+	check_compile_level(thread, arg, "typeInfoLevel", 1, options.options.typeInfoLevel);
+	check_compile_level(thread, arg, "coverageLevel", 2, options.options.coverageLevel);
+	check_compile_string(thread, arg, "vectorLib", options.vector_lib, options.options.vectorLib);
+	check_compile_string(thread, arg, "vectorCtor", options.vector_ctor, options.options.vectorCtor);
+	check_compile_string(thread, arg, "vectorType", options.vector_type, options.options.vectorType);
+	check_compile_list(thread, arg, "mutableGlobals", options.mutable_globals, options.mutable_globals_list, options.options.mutableGlobals);
+	check_compile_list(thread, arg, "userdataTypes", options.userdata_types, options.userdata_types_list, options.options.userdataTypes);
+	check_compile_list(thread, arg, "disabledBuiltins", options.disabled_builtins, options.disabled_builtins_list, options.options.disabledBuiltins);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "luau.h"
+
+#include <Luau/Compiler.h>
+#include <Luau/Location.h>
+#include <Luau/ParseOptions.h>
+
+template <typename T> void destroy_userdata(void* ud) {
+	static_cast<T*>(ud)->~T();
+}
+
+// Locations are `{begin_line, begin_column, end_line, end_column}` so scripts don't have to pattern match a string
+inline void push_location(lua_State* thread, Luau::Location location) {
+	stack_slots_needed(2);
+	lua_createtable(thread, 4, 0);
+	lua_pushunsigned(thread, location.begin.line);
+	lua_rawseti(thread, -2, 1);
+	lua_pushunsigned(thread, location.begin.column);
+	lua_rawseti(thread, -2, 2);
+	lua_pushunsigned(thread, location.end.line);
+	lua_rawseti(thread, -2, 3);
+	lua_pushunsigned(thread, location.end.column);
+	lua_rawseti(thread, -2, 4);
+}
+// Expects a table at top of stack
+inline void set_location(lua_State* thread, Luau::Location location, const char* field = "location") {
+	push_location(thread, location);
+	lua_setfield(thread, -2, field);
+}
+
+// Suffixes tried in order when resolving `require("x")`
+constexpr const char* MODULE_SUFFIXES[] = {"", ".luau", ".lua", "/init.luau", "/init.lua"};
+
+// Runs task(0) through task(count - 1) on as many threads as there are cores, including the calling one
+void run_parallel(size_t count, const std::function<void(size_t)>& task);
+
+// Applies the filesystem plugin's safe mode rules unless osunsafe is loaded. Returns false if the path tries to escape the sandbox.
+bool resolve_sandbox_path(std::filesystem::path& path);
+// For use off the VM's thread, with `unsafe` checked up front
+bool resolve_sandbox_path(std::filesystem::path& path, bool unsafe);
+
+// Reads the `parse` options shared by everything that parses source
+void check_parse_options(lua_State* thread, int arg, Luau::ParseOptions& options);
+
+// Luau::CompileOptions only points to its strings, so this owns them for as long as the options are used
+struct compile_options {
+	Luau::CompileOptions options;
+	std::string vector_lib;
+	std::string vector_ctor;
+	std::string vector_type;
+	std::vector<std::string> mutable_globals;
+	std::vector<std::string> userdata_types;
+	std::vector<std::string> disabled_builtins;
+	std::vector<const char*> mutable_globals_list;
+	std::vector<const char*> userdata_types_list;
+	std::vector<const char*> disabled_builtins_list;
+
+	compile_options() {
+		options.optimizationLevel = 1;
+		options.debugLevel = 1;
+	}
+	compile_options(const compile_options&) = delete;
+	compile_options& operator=(const compile_options&) = delete;
+};
+// Reads the `compile` options, which mirror Luau::CompileOptions
+void check_compile_options(lua_State* thread, int arg, compile_options& options);